@@ -0,0 +1,149 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3/stm32/flash.h>
+
+#include <string.h>
+
+#include "delta.h"
+#include "memory.h"
+#include "memzero.h"
+
+#define SECTOR_BIT(sector) (1 << ((sector)-FLASH_CODE_SECTOR_FIRST))
+
+static uint8_t installed_hashes[FW_CHUNK_COUNT][32];
+static bool installed_valid = false;
+
+static uint16_t chunks_needed = 0;
+static uint16_t chunks_used = 0;
+static uint16_t sectors_erased = 0;
+
+// sector 4 holds chunk 0, sectors 5 to 11 hold two chunks each
+static uint8_t chunk_sector(uint32_t chunk) {
+  if (chunk == 0) {
+    return FLASH_CODE_SECTOR_FIRST;
+  }
+  return FLASH_CODE_SECTOR_FIRST + 1 + (chunk - 1) / 2;
+}
+
+static uint16_t sector_chunks(uint8_t sector) {
+  if (sector == FLASH_CODE_SECTOR_FIRST) {
+    return 1;
+  }
+  uint32_t first = 1 + 2 * (sector - FLASH_CODE_SECTOR_FIRST - 1);
+  return (1 << first) | (1 << (first + 1));
+}
+
+static bool sector_is_empty(uint8_t sector) {
+  for (uint32_t i = 0; i < FW_CHUNK_COUNT; i++) {
+    if (!(sector_chunks(sector) & (1 << i))) {
+      continue;
+    }
+    const uint32_t *p =
+        (const uint32_t *)FLASH_PTR(FLASH_FWHEADER_START + i * FW_CHUNK_SIZE);
+    for (uint32_t j = 0; j < FW_CHUNK_SIZE / sizeof(uint32_t); j++) {
+      if (p[j] != 0xFFFFFFFF) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// installed is the header of the firmware currently in flash, or NULL if its
+// chunk hashes could not be verified
+void delta_start(const image_header *installed) {
+  if (installed) {
+    memcpy(installed_hashes, installed->hashes, sizeof(installed_hashes));
+    installed_valid = true;
+  } else {
+    memzero(installed_hashes, sizeof(installed_hashes));
+    installed_valid = false;
+  }
+  chunks_needed = 0xFFFF;
+  chunks_used = 0xFFFF;
+  sectors_erased = 0;
+}
+
+// decide which chunks of the new image have to be transferred, called once
+// the header of the new image is known
+void delta_plan(const image_header *hdr, uint32_t image_len) {
+  uint32_t used = (image_len + FW_CHUNK_SIZE - 1) / FW_CHUNK_SIZE;
+  chunks_used = (1 << used) - 1;
+
+  // chunk 0 carries the header and is always rewritten
+  chunks_needed = 1;
+  for (uint32_t i = 1; i < used; i++) {
+    if (!installed_valid ||
+        0 != memcmp(installed_hashes[i], hdr->hashes + 32 * i, 32)) {
+      chunks_needed |= 1 << i;
+    }
+  }
+  // chunks which are no longer used by the new image need their sector
+  // erased unless they were unused in the installed image too
+  uint16_t chunks_stale = 0;
+  for (uint32_t i = used; i < FW_CHUNK_COUNT; i++) {
+    if (!installed_valid || !mem_is_empty(installed_hashes[i], 32)) {
+      chunks_stale |= 1 << i;
+    }
+  }
+  // sectors are erased as a whole, so every used chunk sharing a sector with
+  // a changed or stale chunk has to be rewritten as well
+  for (uint8_t s = FLASH_CODE_SECTOR_FIRST; s <= FLASH_CODE_SECTOR_LAST; s++) {
+    if (sector_chunks(s) & (chunks_needed | chunks_stale)) {
+      chunks_needed |= sector_chunks(s) & chunks_used;
+    }
+  }
+}
+
+// first chunk at or after the given one which has to be transferred,
+// FW_CHUNK_COUNT if there is none
+uint32_t delta_next_chunk(uint32_t chunk) {
+  while (chunk < FW_CHUNK_COUNT && !(chunks_needed & (1 << chunk))) {
+    chunk++;
+  }
+  return chunk;
+}
+
+// erase the sector of the chunk before it is programmed, flash has to be
+// unlocked
+void delta_prepare_chunk(uint32_t chunk) {
+  uint8_t sector = chunk_sector(chunk);
+  if (sectors_erased & SECTOR_BIT(sector)) {
+    return;
+  }
+  flash_erase_sector(sector, FLASH_CR_PROGRAM_X32);
+  flash_wait_for_last_operation();
+  sectors_erased |= SECTOR_BIT(sector);
+}
+
+// erase sectors without any chunk of the new image which still contain data
+// of the installed one, flash has to be unlocked
+void delta_erase_unused(void) {
+  for (uint8_t s = FLASH_CODE_SECTOR_FIRST; s <= FLASH_CODE_SECTOR_LAST; s++) {
+    if ((sector_chunks(s) & chunks_used) || (sectors_erased & SECTOR_BIT(s))) {
+      continue;
+    }
+    if (!sector_is_empty(s)) {
+      flash_erase_sector(s, FLASH_CR_PROGRAM_X32);
+      flash_wait_for_last_operation();
+    }
+    sectors_erased |= SECTOR_BIT(s);
+  }
+}
@@ -0,0 +1,40 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "signatures.h"
+
+#define FW_CHUNK_COUNT 16
+
+// Delta firmware update: chunks whose hash matches the installed firmware
+// are neither transferred nor rewritten, as long as their flash sector does
+// not have to be erased for another chunk.
+
+void delta_start(const image_header *installed);
+void delta_plan(const image_header *hdr, uint32_t image_len);
+uint32_t delta_next_chunk(uint32_t chunk);
+void delta_prepare_chunk(uint32_t chunk);
+void delta_erase_unused(void);
+
+#endif
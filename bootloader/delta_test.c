@@ -0,0 +1,262 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host test of the firmware upload against the emulator flash, build and run
+ * with "make EMULATOR=1 test" in the bootloader directory.
+ *
+ * An installed image is written to flash, then a new image is sent through
+ * upload.c the way bootloader/usb.c does, in pieces of the size of a USB
+ * packet payload: with delta only the chunks delta_plan asks for, otherwise
+ * the whole image after the code area was erased. The code area has to hold
+ * exactly the new image afterwards. A corrupted chunk has to be rejected
+ * before anything of it reaches the flash.
+ */
+
+#include <libopencm3/stm32/flash.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "delta.h"
+#include "memory.h"
+#include "setup.h"
+#include "sha2.h"
+#include "signatures.h"
+#include "upload.h"
+#include "util.h"
+
+// payload of a FirmwareUpload packet after the first one
+#define PACKET_LEN 63
+
+// sectors 4 to 11, the last entry of the header hashes has no room in flash
+#define CODE_LEN (FLASH_TOTAL_SIZE - (FLASH_FWHEADER_START - FLASH_ORIGIN))
+#define CODE_CHUNKS (CODE_LEN / FW_CHUNK_SIZE)
+
+static uint8_t flash[FLASH_TOTAL_SIZE];
+static uint8_t image_old[CODE_LEN];
+static uint8_t image_new[CODE_LEN];
+
+static int failures = 0;
+
+// chunks 1 to CODE_CHUNKS - 1 get the content of their seed, a seed of 0
+// leaves the chunk out of the image
+static uint32_t make_image(uint8_t *image, const uint32_t *seeds) {
+  memset(image, 0xFF, CODE_LEN);
+  image_header *hdr = (image_header *)image;
+  memset(hdr, 0, sizeof(image_header));
+  uint32_t chunks = 1;
+  for (uint32_t i = 0; i < CODE_CHUNKS; i++) {
+    if (i > 0 && seeds[i] == 0) {
+      break;
+    }
+    uint32_t x = seeds[i] * 2654435761u + i;
+    uint32_t start = (i == 0) ? FLASH_FWHEADER_LEN : 0;
+    for (uint32_t j = start; j < FW_CHUNK_SIZE; j += 4) {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      memcpy(image + i * FW_CHUNK_SIZE + j, &x, sizeof(x));
+    }
+    chunks = i + 1;
+  }
+  for (uint32_t i = 0; i < chunks; i++) {
+    uint32_t start = (i == 0) ? FLASH_FWHEADER_LEN : 0;
+    sha256_Raw(image + i * FW_CHUNK_SIZE + start, FW_CHUNK_SIZE - start,
+               hdr->hashes + 32 * i);
+  }
+  hdr->codelen = chunks * FW_CHUNK_SIZE - FLASH_FWHEADER_LEN;
+  return chunks * FW_CHUNK_SIZE;
+}
+
+static void install(const uint8_t *image) {
+  flash_unlock();
+  for (uint8_t s = FLASH_CODE_SECTOR_FIRST; s <= FLASH_CODE_SECTOR_LAST; s++) {
+    flash_erase_sector(s, FLASH_CR_PROGRAM_X32);
+  }
+  for (uint32_t pos = 0; pos < CODE_LEN; pos += 4) {
+    uint32_t word;
+    memcpy(&word, image + pos, sizeof(word));
+    if (word != 0xFFFFFFFF) {
+      flash_program_word(FLASH_FWHEADER_START + pos, word);
+    }
+  }
+  flash_lock();
+}
+
+static void erase_code(void) {
+  flash_unlock();
+  for (uint8_t s = FLASH_CODE_SECTOR_FIRST; s <= FLASH_CODE_SECTOR_LAST; s++) {
+    flash_erase_sector(s, FLASH_CR_PROGRAM_X32);
+  }
+  flash_lock();
+}
+
+// sends every range upload.c asks for in pieces of packet bytes, flipping a
+// byte of chunk corrupt (none if FW_CHUNK_COUNT), and programs the header
+// once the image is complete
+static UploadStatus send(const uint8_t *image, uint32_t packet,
+                         uint32_t corrupt, uint16_t *transferred) {
+  static uint8_t piece[FW_CHUNK_SIZE];
+  *transferred = 0;
+  for (;;) {
+    uint32_t pos = upload_pos();
+    uint32_t end = upload_end();
+    *transferred |= 1 << (pos / FW_CHUNK_SIZE);
+    UploadStatus status = UPLOAD_MORE;
+    while (status == UPLOAD_MORE && pos < end) {
+      uint32_t n = MIN(packet, end - pos);
+      memcpy(piece, image + pos, n);
+      uint32_t bad = corrupt * FW_CHUNK_SIZE + FLASH_FWHEADER_LEN;
+      if (bad >= pos && bad < pos + n) {
+        piece[bad - pos] ^= 0x01;
+      }
+      status = upload_receive(piece, n);
+      pos += n;
+    }
+    if (status != UPLOAD_DONE) {
+      return UPLOAD_ERROR;
+    }
+    status = upload_next();
+    if (status == UPLOAD_ERROR) {
+      return status;
+    }
+    if (status == UPLOAD_DONE) {
+      break;
+    }
+  }
+
+  upload_program_header(true);
+  return UPLOAD_DONE;
+}
+
+// the code area has to match image from chunk first on
+static void check_flash(const char *name, const uint8_t *image,
+                        uint32_t first) {
+  const uint8_t *code = FLASH_PTR(FLASH_FWHEADER_START);
+  for (uint32_t i = first; i < CODE_CHUNKS; i++) {
+    if (memcmp(code + i * FW_CHUNK_SIZE, image + i * FW_CHUNK_SIZE,
+               FW_CHUNK_SIZE) != 0) {
+      printf("%s: chunk %u differs\n", name, i);
+      failures++;
+    }
+  }
+}
+
+static void update(const char *name, uint32_t new_len, uint16_t expected) {
+  delta_start((const image_header *)FLASH_PTR(FLASH_FWHEADER_START));
+  upload_init(new_len, true);
+  uint16_t transferred = 0;
+  if (send(image_new, PACKET_LEN, FW_CHUNK_COUNT, &transferred) !=
+      UPLOAD_DONE) {
+    printf("%s: upload failed\n", name);
+    failures++;
+  }
+  if (transferred != expected) {
+    printf("%s: transferred chunks %04x, expected %04x\n", name, transferred,
+           expected);
+    failures++;
+  }
+  check_flash(name, image_new, 0);
+}
+
+// the whole image in one FirmwareUpload, chunks follow each other through
+// the buffers
+static void update_full(const char *name, uint32_t new_len, uint32_t packet) {
+  erase_code();
+  upload_init(new_len, false);
+  uint16_t transferred = 0;
+  if (send(image_new, packet, FW_CHUNK_COUNT, &transferred) != UPLOAD_DONE) {
+    printf("%s: upload failed\n", name);
+    failures++;
+  }
+  check_flash(name, image_new, 0);
+}
+
+// nothing of the corrupted chunk may reach the flash, chunks before it may
+// already be programmed
+static void update_corrupt(const char *name, uint32_t new_len,
+                           uint32_t corrupt) {
+  delta_start((const image_header *)FLASH_PTR(FLASH_FWHEADER_START));
+  upload_init(new_len, true);
+  uint16_t transferred = 0;
+  if (send(image_new, PACKET_LEN, corrupt, &transferred) != UPLOAD_ERROR) {
+    printf("%s: corrupted chunk %u accepted\n", name, corrupt);
+    failures++;
+  }
+  check_flash(name, image_old, corrupt);
+}
+
+int main(void) {
+  emulatorFlashAttach(flash);
+  memset(flash, 0xFF, sizeof(flash));
+  setup();
+
+  // unchanged chunks: only chunk 0 with the header is rewritten
+  static const uint32_t same[FW_CHUNK_COUNT] = {1, 2, 3, 4, 5, 6};
+  make_image(image_old, same);
+  install(image_old);
+  update("unchanged", make_image(image_new, same), 0x0001);
+
+  // chunk 3 changed, chunk 4 shares its sector and is rewritten as well
+  static const uint32_t changed[FW_CHUNK_COUNT] = {1, 2, 3, 40, 5, 6};
+  make_image(image_old, same);
+  install(image_old);
+  update("changed", make_image(image_new, changed), 0x0019);
+
+  // the image shrinks from 8 to 5 chunks, the sectors of chunks 5 to 7 are
+  // erased without being written
+  static const uint32_t long_image[FW_CHUNK_COUNT] = {1, 2, 3, 4, 5, 6, 7, 8};
+  static const uint32_t short_image[FW_CHUNK_COUNT] = {1, 2, 3, 4, 5};
+  make_image(image_old, long_image);
+  install(image_old);
+  update("shrink", make_image(image_new, short_image), 0x0001);
+
+  // the whole image at once, in packets and in pieces larger than the
+  // buffers, so that reception has to wait for programming
+  static const uint32_t full[FW_CHUNK_COUNT] = {1, 2, 3, 4, 5, 6, 7, 8};
+  uint32_t full_len = make_image(image_new, full);
+  update_full("full", full_len, PACKET_LEN);
+  update_full("full, large pieces", full_len, 40000);
+
+  // a corrupted chunk 0 leaves the flash as it was, a corrupted chunk 3 is
+  // rejected after chunk 0 was programmed
+  make_image(image_old, same);
+  install(image_old);
+  update_corrupt("corrupt 0", make_image(image_new, changed), 0);
+  update_corrupt("corrupt 3", make_image(image_new, changed), 3);
+
+  // nothing can be kept if the installed firmware is not trusted
+  make_image(image_old, same);
+  install(image_old);
+  uint32_t len = make_image(image_new, same);
+  delta_start(NULL);
+  delta_plan((const image_header *)image_new, len);
+  if (delta_next_chunk(1) != 1) {
+    printf("untrusted: chunk 1 was skipped\n");
+    failures++;
+  }
+
+  if (failures) {
+    printf("delta_test: %d failures\n", failures);
+    return 1;
+  }
+  printf("delta_test: OK\n");
+  return 0;
+}
@@ -0,0 +1,272 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3/stm32/flash.h>
+
+#include <string.h>
+
+#include "delta.h"
+#include "memory.h"
+#include "memzero.h"
+#include "sha2.h"
+#include "upload.h"
+#include "util.h"
+
+static uint32_t flash_pos = 0, flash_len = 0;
+static uint32_t chunk_idx = 0;
+// the host sends the requested chunks only, see delta.h
+static bool upload_delta = false;
+// end of the data the host was asked for
+static uint32_t recv_end = 0;
+// bytes of the word being assembled
+static uint32_t w = 0;
+static int wi = 0;
+
+static uint32_t FW_HEADER[FLASH_FWHEADER_LEN / sizeof(uint32_t)];
+
+// Each chunk is received into two half-size buffers and hashed after every
+// packet. A chunk is programmed only once its hash matched, a few words per
+// packet while the next chunk is received into the same buffers. Programming
+// reads the buffers ahead of reception, a word of the verified chunk is
+// always programmed before the next chunk overwrites it.
+#define FW_HALF_SIZE (FW_CHUNK_SIZE / 2)
+#define FW_PROGRAM_WORDS_PER_PACKET 32
+
+static uint32_t FW_BUFFER[2][FW_HALF_SIZE / sizeof(uint32_t)];
+static uint32_t hash_pos = 0;
+// verified data waiting in the buffers to be programmed
+static uint32_t prog_pos = 0, prog_end = 0;
+static SHA256_CTX chunk_ctx;
+
+static uint8_t *chunk_data(uint32_t pos) {
+  uint32_t chunk_pos = pos % FW_CHUNK_SIZE;
+  return (uint8_t *)FW_BUFFER[chunk_pos / FW_HALF_SIZE] +
+         chunk_pos % FW_HALF_SIZE;
+}
+
+// first byte of the chunk which is kept in the buffers, chunk 0 starts with
+// the header which is kept separately
+static uint32_t chunk_data_start(uint32_t idx) {
+  return idx * FW_CHUNK_SIZE + (idx == 0 ? FLASH_FWHEADER_LEN : 0);
+}
+
+static void start_chunk(uint32_t idx) {
+  chunk_idx = idx;
+  hash_pos = chunk_data_start(idx);
+  sha256_Init(&chunk_ctx);
+}
+
+static void hash_received(void) {
+  while (hash_pos < flash_pos) {
+    uint32_t end = MIN(flash_pos, (hash_pos / FW_HALF_SIZE + 1) * FW_HALF_SIZE);
+    sha256_Update(&chunk_ctx, chunk_data(hash_pos), end - hash_pos);
+    hash_pos = end;
+  }
+}
+
+static void program_verified(uint32_t max_words) {
+  if (prog_pos >= prog_end) {
+    return;
+  }
+  flash_wait_for_last_operation();
+  flash_clear_status_flags();
+  flash_unlock();
+  if (upload_delta) {
+    delta_prepare_chunk(prog_pos / FW_CHUNK_SIZE);
+  }
+#if !EMULATOR
+  // set PG once for the whole run instead of per word as flash_program_word
+  // does, x32 is the widest program size available without external Vpp
+  FLASH_CR = (FLASH_CR & ~(FLASH_CR_PROGRAM_MASK << FLASH_CR_PROGRAM_SHIFT)) |
+             (FLASH_CR_PROGRAM_X32 << FLASH_CR_PROGRAM_SHIFT);
+  FLASH_CR |= FLASH_CR_PG;
+#endif
+  while (prog_pos < prog_end && max_words > 0) {
+    flash_write32(FLASH_FWHEADER_START + prog_pos,
+                  *(const uint32_t *)chunk_data(prog_pos));
+    flash_wait_for_last_operation();
+    prog_pos += sizeof(uint32_t);
+    max_words--;
+  }
+#if !EMULATOR
+  FLASH_CR &= ~FLASH_CR_PG;
+#endif
+  flash_lock();
+}
+
+// the buffer word for pos still holds verified data of the previous chunk
+static bool buffer_pending(uint32_t pos) {
+  return prog_pos < prog_end &&
+         prog_pos % FW_CHUNK_SIZE <= pos % FW_CHUNK_SIZE;
+}
+
+static bool check_chunk(void) {
+  // a short last chunk is padded over what is left of the previous one
+  program_verified(UINT32_MAX);
+  hash_received();
+  uint32_t chunk_start = chunk_idx * FW_CHUNK_SIZE;
+  // pad with FF, the buffers past the received data are not needed anymore
+  for (uint32_t pos = flash_pos; pos < chunk_start + FW_CHUNK_SIZE;) {
+    uint32_t end = (pos / FW_HALF_SIZE + 1) * FW_HALF_SIZE;
+    memset(chunk_data(pos), 0xFF, end - pos);
+    sha256_Update(&chunk_ctx, chunk_data(pos), end - pos);
+    pos = end;
+  }
+  uint8_t hash[32];
+  sha256_Final(&chunk_ctx, hash);
+
+  const image_header *hdr = (const image_header *)FW_HEADER;
+  // invalid chunk sent
+  if (0 != memcmp(hash, hdr->hashes + chunk_idx * 32, 32)) {
+    return false;
+  }
+
+  prog_pos = chunk_data_start(chunk_idx);
+  prog_end = flash_pos;
+  start_chunk(chunk_idx + 1);
+  return true;
+}
+
+static bool unused_chunks_empty(void) {
+  const image_header *hdr = (const image_header *)FW_HEADER;
+  for (uint32_t i = (flash_len + FW_CHUNK_SIZE - 1) / FW_CHUNK_SIZE;
+       i < FW_CHUNK_COUNT; i++) {
+    // hash should be empty if the chunk is unused
+    if (!mem_is_empty(hdr->hashes + 32 * i, 32)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void request_chunk(uint32_t idx) {
+  start_chunk(idx);
+  flash_pos = idx * FW_CHUNK_SIZE;
+  recv_end = MIN(flash_pos + FW_CHUNK_SIZE, flash_len);
+  w = 0;
+  wi = 0;
+}
+
+// start receiving an image of len bytes, from the first chunk on; with delta
+// only chunk 0 is requested, upload_next asks for the others
+void upload_init(uint32_t len, bool delta) {
+  flash_len = len;
+  upload_delta = delta;
+  prog_pos = prog_end = 0;
+  memzero(FW_HEADER, sizeof(FW_HEADER));
+  request_chunk(0);
+  if (!delta) {
+    recv_end = flash_len;
+  }
+}
+
+// take the next piece of the requested data, anything past its end is
+// ignored
+UploadStatus upload_receive(const uint8_t *data, size_t len) {
+  const uint8_t *p = data;
+  while (p < data + len && flash_pos < recv_end) {
+    w = (w >> 8) | (*p << 24);  // assign byte to first byte of uint32_t w
+    wi++;
+    if (wi == 4) {
+      if (flash_pos < FLASH_FWHEADER_LEN) {
+        FW_HEADER[flash_pos / 4] = w;
+      } else {
+        while (buffer_pending(flash_pos)) {
+          program_verified(FW_PROGRAM_WORDS_PER_PACKET);
+        }
+        *(uint32_t *)chunk_data(flash_pos) = w;
+      }
+      flash_pos += 4;
+      wi = 0;
+      // finished the whole chunk
+      if (flash_pos % FW_CHUNK_SIZE == 0 && !check_chunk()) {
+        return UPLOAD_ERROR;
+      }
+    }
+    p++;
+  }
+  if (flash_pos < recv_end) {
+    hash_received();
+    program_verified(FW_PROGRAM_WORDS_PER_PACKET);
+    return UPLOAD_MORE;
+  }
+  // flush remaining data in the last chunk
+  if (flash_pos % FW_CHUNK_SIZE > 0 && !check_chunk()) {
+    return UPLOAD_ERROR;
+  }
+  return UPLOAD_DONE;
+}
+
+// after the requested data is done: UPLOAD_MORE if another chunk has to be
+// requested (upload_pos to upload_end), UPLOAD_DONE once the image is in
+// flash except for the header, UPLOAD_ERROR if the header lists hashes of
+// chunks past the image
+UploadStatus upload_next(void) {
+  if (upload_delta) {
+    // the header came with chunk 0, now we know what else to ask for
+    if (chunk_idx == 1) {
+      if (!unused_chunks_empty()) {
+        return UPLOAD_ERROR;
+      }
+      delta_plan((const image_header *)FW_HEADER, flash_len);
+    }
+    uint32_t next = delta_next_chunk(chunk_idx);
+    if (next * FW_CHUNK_SIZE < flash_len) {
+      // the verified chunk is programmed while the next one arrives
+      request_chunk(next);
+      return UPLOAD_MORE;
+    }
+  } else if (!unused_chunks_empty()) {
+    return UPLOAD_ERROR;
+  }
+  // nothing else arrives to overlap the last chunk with
+  program_verified(UINT32_MAX);
+  if (upload_delta) {
+    flash_wait_for_last_operation();
+    flash_clear_status_flags();
+    flash_unlock();
+    delta_erase_unused();
+    flash_lock();
+  }
+  return UPLOAD_DONE;
+}
+
+// the header is kept in RAM until the image was accepted, a rejected image
+// gets a zero header
+void upload_program_header(bool accepted) {
+  flash_wait_for_last_operation();
+  flash_clear_status_flags();
+  flash_unlock();
+  for (size_t i = 0; i < FLASH_FWHEADER_LEN / sizeof(uint32_t); i++) {
+    flash_program_word(FLASH_FWHEADER_START + i * sizeof(uint32_t),
+                       accepted ? FW_HEADER[i] : 0);
+  }
+  flash_wait_for_last_operation();
+  flash_lock();
+}
+
+const image_header *upload_header(void) {
+  return (const image_header *)FW_HEADER;
+}
+
+uint32_t upload_pos(void) { return flash_pos; }
+
+uint32_t upload_end(void) { return recv_end; }
+
+uint32_t upload_len(void) { return flash_len; }
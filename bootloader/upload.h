@@ -0,0 +1,50 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __UPLOAD_H__
+#define __UPLOAD_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "signatures.h"
+
+// Receiving, verifying and programming the firmware image, independent of
+// USB so that it can run on the host. Each chunk is hashed while it arrives
+// and programmed only after its hash matched the header, while the next
+// chunk is received.
+
+typedef enum {
+  UPLOAD_ERROR,  // a chunk or the header is invalid
+  UPLOAD_MORE,   // the requested range is not complete yet
+  UPLOAD_DONE,   // the requested range, or the whole image, is complete
+} UploadStatus;
+
+void upload_init(uint32_t len, bool delta);
+UploadStatus upload_receive(const uint8_t *data, size_t len);
+UploadStatus upload_next(void);
+void upload_program_header(bool accepted);
+
+const image_header *upload_header(void);
+uint32_t upload_pos(void);
+uint32_t upload_end(void);
+uint32_t upload_len(void);
+
+#endif
@@ -24,6 +24,7 @@
 
 #include "bootloader.h"
 #include "buttons.h"
+#include "delta.h"
 #include "ecdsa.h"
 #include "layout.h"
 #include "memory.h"
@@ -33,6 +34,7 @@
 #include "secp256k1.h"
 #include "sha2.h"
 #include "signatures.h"
+#include "upload.h"
 #include "usb.h"
 #include "util.h"
 
@@ -53,76 +55,37 @@ enum {
   STATE_END,
 };
 
-static uint32_t flash_pos = 0, flash_len = 0;
-static uint32_t chunk_idx = 0;
 static char flash_state = STATE_READY;
 
-static uint32_t FW_HEADER[FLASH_FWHEADER_LEN / sizeof(uint32_t)];
-static uint32_t FW_CHUNK[FW_CHUNK_SIZE / sizeof(uint32_t)];
+// hosts announcing the image length in FirmwareErase get the firmware
+// requested chunk by chunk, which allows skipping unchanged chunks
+static bool upload_requested = false;
 
-static void check_and_write_chunk(void) {
-  uint32_t offset = (chunk_idx == 0) ? FLASH_FWHEADER_LEN : 0;
-  uint32_t chunk_pos = flash_pos % FW_CHUNK_SIZE;
-  if (chunk_pos == 0) {
-    chunk_pos = FW_CHUNK_SIZE;
-  }
-  uint8_t hash[32];
-  SHA256_CTX ctx;
-  sha256_Init(&ctx);
-  sha256_Update(&ctx, (const uint8_t *)FW_CHUNK + offset, chunk_pos - offset);
-  if (chunk_pos < 64 * 1024) {
-    // pad with FF
-    for (uint32_t i = chunk_pos; i < 64 * 1024; i += 4) {
-      sha256_Update(&ctx, (const uint8_t *)"\xFF\xFF\xFF\xFF", 4);
-    }
-  }
-  sha256_Final(&ctx, hash);
-
-  const image_header *hdr = (const image_header *)FW_HEADER;
-  // invalid chunk sent
-  if (0 != memcmp(hash, hdr->hashes + chunk_idx * 32, 32)) {
-    // erase storage
-    erase_storage();
+static bool check_firmware_len(usbd_device *dev, uint32_t len) {
+  if (len <= FLASH_FWHEADER_LEN) {  // firmware is too small
+    send_msg_failure(dev);
     flash_state = STATE_END;
-    show_halt("Error installing", "firmware.");
-    return;
+    show_halt("Firmware is too small.", NULL);
+    return false;
   }
-
-  flash_wait_for_last_operation();
-  flash_clear_status_flags();
-  flash_unlock();
-  for (uint32_t i = offset / sizeof(uint32_t); i < chunk_pos / sizeof(uint32_t);
-       i++) {
-    flash_program_word(
-        FLASH_FWHEADER_START + chunk_idx * FW_CHUNK_SIZE + i * sizeof(uint32_t),
-        FW_CHUNK[i]);
-  }
-  flash_wait_for_last_operation();
-  flash_lock();
-
-  // all done
-  if (flash_len == flash_pos) {
-    // check remaining chunks if any
-    for (uint32_t i = chunk_idx + 1; i < 16; i++) {
-      // hash should be empty if the chunk is unused
-      if (!mem_is_empty(hdr->hashes + 32 * i, 32)) {
-        flash_state = STATE_END;
-        show_halt("Error installing", "firmware.");
-        return;
-      }
-    }
+  if (len > FLASH_FWHEADER_LEN + FLASH_APP_LEN) {  // firmware is too big
+    send_msg_failure(dev);
+    flash_state = STATE_END;
+    show_halt("Firmware is too big.", NULL);
+    return false;
   }
+  return true;
+}
 
-  memzero(FW_CHUNK, sizeof(FW_CHUNK));
-  chunk_idx++;
+static void request_chunk(usbd_device *dev) {
+  send_msg_firmwarerequest(dev, upload_pos(), upload_end() - upload_pos());
+  flash_state = STATE_FLASHSTART;
 }
 
 static void rx_callback(usbd_device *dev, uint8_t ep) {
   (void)ep;
   static uint16_t msg_id = 0xFFFF;
   static uint8_t buf[64] __attribute__((aligned(4)));
-  static uint32_t w;
-  static int wi;
   static int old_was_signed;
 
   if (usbd_ep_read_packet(dev, ENDPOINT_ADDRESS_OUT, buf, 64) != 64) return;
@@ -180,6 +143,16 @@ static void rx_callback(usbd_device *dev, uint8_t ep) {
 
   if (flash_state == STATE_OPEN) {
     if (msg_id == 0x0006) {  // FirmwareErase message (id 6)
+      upload_requested = false;
+      uint32_t flash_len = 0;
+      if (buf[8] > 0 && buf[9] == 0x08) {  // length is present
+        const uint8_t *p = buf + 10;
+        flash_len = readprotobufint(&p);
+        if (!check_firmware_len(dev, flash_len)) {
+          return;
+        }
+        upload_requested = true;
+      }
       bool proceed = false;
       if (firmware_present_new()) {
         layoutDialog(&bmp_icon_question, "Abort", "Continue", NULL,
@@ -191,19 +164,32 @@ static void rx_callback(usbd_device *dev, uint8_t ep) {
       }
       if (proceed) {
         // check whether the current firmware is signed (old or new method)
+        const image_header *installed = NULL;
         if (firmware_present_new()) {
           const image_header *hdr =
               (const image_header *)FLASH_PTR(FLASH_FWHEADER_START);
-          old_was_signed =
-              signatures_new_ok(hdr, NULL) & check_firmware_hashes(hdr);
+          int hashes_ok = check_firmware_hashes(hdr);
+          old_was_signed = signatures_new_ok(hdr, NULL) & hashes_ok;
+          // chunks of the installed firmware can only be kept if they
+          // match its hashes
+          if (hashes_ok == SIG_OK) {
+            installed = hdr;
+          }
         } else if (firmware_present_old()) {
           old_was_signed = signatures_old_ok();
         } else {
           old_was_signed = SIG_FAIL;
         }
-        erase_code_progress();
-        send_msg_success(dev);
-        flash_state = STATE_FLASHSTART;
+        if (upload_requested) {
+          // sectors are erased on demand while the chunks are written
+          delta_start(installed);
+          upload_init(flash_len, true);
+          request_chunk(dev);
+        } else {
+          erase_code_progress();
+          send_msg_success(dev);
+          flash_state = STATE_FLASHSTART;
+        }
       } else {
         send_msg_failure(dev);
         flash_state = STATE_END;
@@ -216,6 +202,8 @@ static void rx_callback(usbd_device *dev, uint8_t ep) {
     return;
   }
 
+  const uint8_t *p = buf + 1;
+
   if (flash_state == STATE_FLASHSTART) {
     if (msg_id == 0x0007) {  // FirmwareUpload message (id 7)
       if (buf[9] != 0x0a) {  // invalid contents
@@ -225,50 +213,34 @@ static void rx_callback(usbd_device *dev, uint8_t ep) {
         return;
       }
       // read payload length
-      const uint8_t *p = buf + 10;
-      flash_len = readprotobufint(&p);
-      if (flash_len <= FLASH_FWHEADER_LEN) {  // firmware is too small
-        send_msg_failure(dev);
-        flash_state = STATE_END;
-        show_halt("Firmware is too small.", NULL);
-        return;
-      }
-      if (flash_len >
-          FLASH_FWHEADER_LEN + FLASH_APP_LEN) {  // firmware is too big
-        send_msg_failure(dev);
-        flash_state = STATE_END;
-        show_halt("Firmware is too big.", NULL);
-        return;
+      p = buf + 10;
+      uint32_t payload_len = readprotobufint(&p);
+      if (upload_requested) {
+        // not what we asked for
+        if (payload_len != upload_end() - upload_pos()) {
+          send_msg_failure(dev);
+          flash_state = STATE_END;
+          show_halt("Error installing", "firmware.");
+          return;
+        }
+      } else {
+        if (!check_firmware_len(dev, payload_len)) {
+          return;
+        }
+        upload_init(payload_len, false);
       }
       // check firmware magic
-      if (memcmp(p, &FIRMWARE_MAGIC_NEW, 4) != 0) {
+      if (upload_pos() == 0 && memcmp(p, &FIRMWARE_MAGIC_NEW, 4) != 0) {
         send_msg_failure(dev);
         flash_state = STATE_END;
         show_halt("Wrong firmware header.", NULL);
         return;
       }
-      memzero(FW_HEADER, sizeof(FW_HEADER));
-      memzero(FW_CHUNK, sizeof(FW_CHUNK));
       flash_state = STATE_FLASHING;
-      flash_pos = 0;
-      chunk_idx = 0;
-      w = 0;
-      while (p < buf + 64) {
-        w = (w >> 8) | (*p << 24);  // assign byte to first byte of uint32_t w
-        wi++;
-        if (wi == 4) {
-          FW_HEADER[flash_pos / 4] = w;
-          flash_pos += 4;
-          wi = 0;
-        }
-        p++;
-      }
+    } else {
       return;
     }
-    return;
-  }
-
-  if (flash_state == STATE_FLASHING) {
+  } else if (flash_state == STATE_FLASHING) {
     if (buf[0] != '?') {  // invalid contents
       send_msg_failure(dev);
       flash_state = STATE_END;
@@ -279,49 +251,46 @@ static void rx_callback(usbd_device *dev, uint8_t ep) {
     static uint8_t flash_anim = 0;
     if (flash_anim % 32 == 4) {
       layoutProgress("INSTALLING ... Please wait",
-                     1000 * flash_pos / flash_len);
+                     1000 * upload_pos() / upload_len());
     }
     flash_anim++;
+  }
 
-    const uint8_t *p = buf + 1;
-    while (p < buf + 64 && flash_pos < flash_len) {
-      w = (w >> 8) | (*p << 24);  // assign byte to first byte of uint32_t w
-      wi++;
-      if (wi == 4) {
-        if (flash_pos < FLASH_FWHEADER_LEN) {
-          FW_HEADER[flash_pos / 4] = w;
-        } else {
-          FW_CHUNK[(flash_pos % FW_CHUNK_SIZE) / 4] = w;
-        }
-        flash_pos += 4;
-        wi = 0;
-        // finished the whole chunk
-        if (flash_pos % FW_CHUNK_SIZE == 0) {
-          check_and_write_chunk();
-        }
-      }
-      p++;
+  if (flash_state == STATE_FLASHING) {
+    UploadStatus status = upload_receive(p, buf + 64 - p);
+    if (status == UPLOAD_MORE) {
+      return;
+    }
+    // invalid chunk sent
+    if (status == UPLOAD_ERROR) {
+      // erase storage
+      erase_storage();
+      flash_state = STATE_END;
+      show_halt("Error installing", "firmware.");
+      return;
+    }
+    status = upload_next();
+    if (status == UPLOAD_ERROR) {
+      flash_state = STATE_END;
+      show_halt("Error installing", "firmware.");
+      return;
+    }
+    if (status == UPLOAD_MORE) {
+      request_chunk(dev);
+      return;
     }
     // flashing done
-    if (flash_pos == flash_len) {
-      // flush remaining data in the last chunk
-      if (flash_pos % FW_CHUNK_SIZE > 0) {
-        check_and_write_chunk();
-      }
-      flash_state = STATE_CHECK;
-      const image_header *hdr = (const image_header *)FW_HEADER;
-      if (SIG_OK != signatures_new_ok(hdr, NULL)) {
-        send_msg_buttonrequest_firmwarecheck(dev);
-        return;
-      }
-    } else {
+    flash_state = STATE_CHECK;
+    const image_header *hdr = upload_header();
+    if (SIG_OK != signatures_new_ok(hdr, NULL)) {
+      send_msg_buttonrequest_firmwarecheck(dev);
       return;
     }
   }
 
   if (flash_state == STATE_CHECK) {
     // use the firmware header from RAM
-    const image_header *hdr = (const image_header *)FW_HEADER;
+    const image_header *hdr = upload_header();
 
     bool hash_check_ok;
     // show fingerprint of unsigned firmware
@@ -359,22 +328,8 @@ static void rx_callback(usbd_device *dev, uint8_t ep) {
         return;
       }
     }
-    flash_wait_for_last_operation();
-    flash_clear_status_flags();
-    flash_unlock();
     // write firmware header only when hash was confirmed
-    if (hash_check_ok) {
-      for (size_t i = 0; i < FLASH_FWHEADER_LEN / sizeof(uint32_t); i++) {
-        flash_program_word(FLASH_FWHEADER_START + i * sizeof(uint32_t),
-                           FW_HEADER[i]);
-      }
-    } else {
-      for (size_t i = 0; i < FLASH_FWHEADER_LEN / sizeof(uint32_t); i++) {
-        flash_program_word(FLASH_FWHEADER_START + i * sizeof(uint32_t), 0);
-      }
-    }
-    flash_wait_for_last_operation();
-    flash_lock();
+    upload_program_header(hash_check_ok);
 
     flash_state = STATE_END;
     if (hash_check_ok) {
@@ -34,6 +34,39 @@ static void send_msg_failure(usbd_device *dev) {
   }
 }
 
+static uint8_t *write_protobufint(uint8_t *p, uint32_t value) {
+  while (value >= 0x80) {
+    *p++ = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  *p++ = value;
+  return p;
+}
+
+static void send_msg_firmwarerequest(usbd_device *dev, uint32_t offset,
+                                     uint32_t length) {
+  uint8_t response[64];
+  memzero(response, sizeof(response));
+  // response: FirmwareRequest message (id 8), payload len 2 to 12
+  //           - offset = offset
+  //           - length = length
+  memcpy(response,
+         // header
+         "?##"
+         // msg_id
+         "\x00\x08",
+         5);
+  uint8_t *p = response + 9;
+  *p++ = 0x08;
+  p = write_protobufint(p, offset);
+  *p++ = 0x10;
+  p = write_protobufint(p, length);
+  // msg_size
+  response[8] = p - (response + 9);
+  while (usbd_ep_write_packet(dev, ENDPOINT_ADDRESS_IN, response, 64) != 64) {
+  }
+}
+
 static void send_msg_features(usbd_device *dev) {
   uint8_t response[64];
   memzero(response, sizeof(response));
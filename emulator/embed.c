@@ -0,0 +1,205 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "buttons.h"
+#include "embed.h"
+#include "firmware/trezor.h"
+#include "memory.h"
+#include "rng.h"
+#include "setup.h"
+#include "util.h"
+
+/* Replaces udp.o and buttons.o in libemulator-embed.a: reports and button
+ * presses go through in-memory queues instead of sockets and SDL. */
+
+#define EMBED_QUEUE_SIZE 64
+#define EMBED_BUTTON_QUEUE_SIZE 8
+
+struct embed_report {
+  uint8_t iface;
+  uint8_t size;
+  uint8_t data[TREZOR_EMBED_REPORT_SIZE];
+};
+
+struct embed_queue {
+  struct embed_report reports[EMBED_QUEUE_SIZE];
+  size_t head;
+  size_t count;
+};
+
+static struct embed_queue inbound;
+static struct embed_queue outbound;
+
+static uint16_t buttons[EMBED_BUTTON_QUEUE_SIZE];
+static size_t buttons_head = 0, buttons_count = 0;
+
+static trezorEmbedIdleCallback idle_callback = NULL;
+static void *idle_context = NULL;
+
+/* Set whenever the firmware consumed or produced a report */
+static bool activity = false;
+
+static bool queue_push(struct embed_queue *queue, int iface,
+                       const uint8_t *data, size_t size) {
+  if (queue->count == EMBED_QUEUE_SIZE || size > TREZOR_EMBED_REPORT_SIZE) {
+    return false;
+  }
+  struct embed_report *report =
+      &queue->reports[(queue->head + queue->count) % EMBED_QUEUE_SIZE];
+  report->iface = iface;
+  report->size = size;
+  memcpy(report->data, data, size);
+  queue->count++;
+  return true;
+}
+
+static size_t queue_pop(struct embed_queue *queue, int *iface, uint8_t *data,
+                        size_t size) {
+  if (queue->count == 0) {
+    return 0;
+  }
+  const struct embed_report *report = &queue->reports[queue->head];
+  queue->head = (queue->head + 1) % EMBED_QUEUE_SIZE;
+  queue->count--;
+
+  *iface = report->iface;
+  size = MIN(size, report->size);
+  memcpy(data, report->data, size);
+  return size;
+}
+
+void emulatorSocketInit(void) {}
+
+/* The host has to pop reports before the firmware may write more. With an
+ * idle callback it gets the chance right away, otherwise the firmware reads
+ * nothing new until trezorEmbedPoll returned and the host drained the
+ * queue. */
+static bool outbound_blocked(void) {
+  if (outbound.count == EMBED_QUEUE_SIZE && idle_callback) {
+    idle_callback(idle_context);
+  }
+  return outbound.count == EMBED_QUEUE_SIZE;
+}
+
+size_t emulatorSocketRead(int *iface, void *buffer, size_t size) {
+  // no new requests while their responses could not be written
+  if (outbound_blocked()) {
+    return 0;
+  }
+  if (inbound.count == 0 && idle_callback) {
+    idle_callback(idle_context);
+  }
+
+  size_t n = queue_pop(&inbound, iface, buffer, size);
+  if (n > 0) {
+    activity = true;
+  }
+  return n;
+}
+
+bool emulatorSocketWait(uint32_t millis) {
+  (void)millis;
+  // the host drives the clock, so never block
+  if (outbound_blocked()) {
+    return false;
+  }
+  if (inbound.count == 0 && idle_callback) {
+    idle_callback(idle_context);
+  }
+  return inbound.count > 0;
+}
+
+bool emulatorSocketWritable(int iface) {
+  (void)iface;
+  return !outbound_blocked();
+}
+
+size_t emulatorSocketWrite(int iface, const void *buffer, size_t size) {
+  // callers check emulatorSocketWritable first, this never drops a report
+  // that fits
+  if (outbound_blocked()) {
+    return 0;
+  }
+  activity = true;
+  return queue_push(&outbound, iface, buffer, size) ? size : 0;
+}
+
+uint16_t buttonRead(void) {
+  uint16_t state = 0;
+  if (buttons_count > 0) {
+    state = buttons[buttons_head];
+    buttons_head = (buttons_head + 1) % EMBED_BUTTON_QUEUE_SIZE;
+    buttons_count--;
+  }
+  return ~state;
+}
+
+size_t trezorEmbedFlashSize(void) { return FLASH_TOTAL_SIZE; }
+
+/* Sets the stack guard between trezor_setup and trezor_init like main. This
+ * frame returns to the host, so it must not check the guard itself. */
+#ifdef __has_attribute
+#if __has_attribute(no_stack_protector)
+__attribute__((no_stack_protector))
+#endif
+#endif
+void trezorEmbedInit(uint8_t *flash) {
+  emulatorFlashAttach(flash);
+  emulatorSetVirtualTime(true);
+  trezor_setup();
+  __stack_chk_guard = random32();
+  trezor_init();
+}
+
+bool trezorEmbedPush(int iface, const uint8_t *report, size_t size) {
+  return queue_push(&inbound, iface, report, size);
+}
+
+size_t trezorEmbedPop(int *iface, uint8_t *report, size_t size) {
+  return queue_pop(&outbound, iface, report, size);
+}
+
+bool trezorEmbedPoll(void) {
+  // responses are sent one report per poll, so keep going until the
+  // firmware has nothing left to read or write
+  do {
+    activity = false;
+    trezor_poll();
+  } while (activity ||
+           (inbound.count > 0 && outbound.count < EMBED_QUEUE_SIZE));
+  return outbound.count < EMBED_QUEUE_SIZE;
+}
+
+void trezorEmbedAdvanceTime(uint32_t millis) { emulatorAdvanceTime(millis); }
+
+void trezorEmbedPress(bool yes, bool no) {
+  if (buttons_count == EMBED_BUTTON_QUEUE_SIZE) {
+    return;
+  }
+  uint16_t state = (yes ? BTN_PIN_YES : 0) | (no ? BTN_PIN_NO : 0);
+  buttons[(buttons_head + buttons_count) % EMBED_BUTTON_QUEUE_SIZE] = state;
+  buttons_count++;
+}
+
+void trezorEmbedSetIdle(trezorEmbedIdleCallback callback, void *context) {
+  idle_callback = callback;
+  idle_context = context;
+}
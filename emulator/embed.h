@@ -0,0 +1,70 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EMBED_H__
+#define __EMBED_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * In-process interface to the emulator firmware, provided by
+ * firmware/libtrezor-embed.a instead of the UDP sockets and SDL buttons.
+ *
+ * Reports are 64 bytes long; interface 0 carries the regular messages,
+ * interface 1 the debug link. The firmware only runs inside
+ * trezorEmbedPoll, so all functions must be called from one thread.
+ */
+
+#define TREZOR_EMBED_REPORT_SIZE 64
+
+/* Called whenever the firmware looks for input and none is queued,
+ * including while it waits for a confirmation in the middle of a message,
+ * and when the outbound queue is full. */
+typedef void (*trezorEmbedIdleCallback)(void *context);
+
+/* Size of the flash image passed to trezorEmbedInit */
+size_t trezorEmbedFlashSize(void);
+
+/* Start the firmware on the given flash image, which is used in place
+ * and must stay valid. With NULL the firmware starts on erased flash. */
+void trezorEmbedInit(uint8_t *flash);
+
+/* Queue a report from the host, false if the queue is full */
+bool trezorEmbedPush(int iface, const uint8_t *report, size_t size);
+
+/* Take the next report sent by the firmware, 0 if there is none */
+size_t trezorEmbedPop(int *iface, uint8_t *report, size_t size);
+
+/* Run the firmware until it has processed all queued reports. Returns
+ * false if it stopped because the outbound queue is full and no idle
+ * callback drained it: pop the reports and poll again. Nothing is
+ * dropped, the firmware keeps the rest of its responses queued. */
+bool trezorEmbedPoll(void);
+
+/* Move the firmware clock forward */
+void trezorEmbedAdvanceTime(uint32_t millis);
+
+/* Press and release the buttons on the next button read */
+void trezorEmbedPress(bool yes, bool no);
+
+void trezorEmbedSetIdle(trezorEmbedIdleCallback callback, void *context);
+
+#endif
@@ -24,14 +24,29 @@
 
 #include "strl.h"
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 void emulatorPoll(void);
 void emulatorRandom(void *buffer, size_t size);
 
+void emulatorAdvanceTime(uint32_t millis);
+void emulatorSetVirtualTime(bool enabled);
+
+void emulatorFlashDirty(const volatile void *ptr, size_t size);
+void emulatorFlashCommit(void);
+
+void emulatorFlashSnapshot(void);
+bool emulatorFlashRestore(void);
+bool emulatorFlashSnapshotLoaded(void);
+void emulatorFlashAttach(uint8_t *buffer);
+
 void emulatorSocketInit(void);
 size_t emulatorSocketRead(int *iface, void *buffer, size_t size);
 size_t emulatorSocketWrite(int iface, const void *buffer, size_t size);
+bool emulatorSocketWritable(int iface);
+bool emulatorSocketWait(uint32_t millis);
 
 #endif
 
@@ -20,16 +20,17 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <string.h>
-#include <unistd.h>
 
 #include "memory.h"
 
-void flash_lock(void) { sync(); }
+void flash_lock(void) { emulatorFlashCommit(); }
 
 void flash_unlock(void) {}
 
 void flash_clear_status_flags(void) {}
 
+void flash_wait_for_last_operation(void) {}
+
 void flash_lock_option_bytes(void) {}
 void flash_unlock_option_bytes(void) {}
 
@@ -55,6 +56,14 @@ static ssize_t sector_to_offset(uint8_t sector) {
       return 0x60000;
     case 8:
       return 0x80000;
+    case 9:
+      return 0xA0000;
+    case 10:
+      return 0xC0000;
+    case 11:
+      return 0xE0000;
+    case 12:
+      return 0x100000;
     default:
       return -1;
   }
@@ -97,20 +106,24 @@ void flash_erase_sector(uint8_t sector, uint32_t program_size) {
   }
 
   memset(address, 0xFF, size);
+  emulatorFlashDirty(address, size);
 }
 
 void flash_erase_all_sectors(uint32_t program_size) {
   (void)program_size;
 
   memset(emulator_flash_base, 0xFF, FLASH_TOTAL_SIZE);
+  emulatorFlashDirty(emulator_flash_base, FLASH_TOTAL_SIZE);
 }
 
 void flash_program_word(uint32_t address, uint32_t data) {
   *(volatile uint32_t *)FLASH_PTR(address) = data;
+  emulatorFlashDirty(FLASH_PTR(address), sizeof(data));
 }
 
 void flash_program_byte(uint32_t address, uint8_t data) {
   *(volatile uint8_t *)FLASH_PTR(address) = data;
+  emulatorFlashDirty(FLASH_PTR(address), sizeof(data));
 }
 
 static bool flash_locked = true;
@@ -131,6 +144,6 @@ void svc_flash_erase_sector(uint16_t sector) {
 uint32_t svc_flash_lock(void) {
   assert(!flash_locked);
   flash_locked = true;
-  sync();
+  emulatorFlashCommit();
   return 0;
 }
@@ -18,11 +18,12 @@
  */
 
 #include "oled.h"
+#include "profile.h"
 
 #if HEADLESS
 
 void oledInit(void) {}
-void oledRefresh(void) {}
+void oledRefresh(void) { oledRefreshed(); }
 void emulatorPoll(void) {}
 
 #else
@@ -112,6 +113,8 @@ void oledInit(void) {
 }
 
 void oledRefresh(void) {
+  PROFILE_START(PROFILE_OLED_REFRESH);
+
   /* Draw triangle in upper right corner */
   oledInvertDebugLink();
 
@@ -135,6 +138,8 @@ void oledRefresh(void) {
 
   /* Return it back */
   oledInvertDebugLink();
+  oledRefreshed();
+  PROFILE_END(PROFILE_OLED_REFRESH);
 }
 
 void emulatorPoll(void) {
@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -31,17 +32,56 @@
 #include "rng.h"
 #include "setup.h"
 #include "timer.h"
+#include "util.h"
 
 #define EMULATOR_FLASH_FILE "emulator.img"
 
+#define ENV_FLASH_MODE "TREZOR_FLASH_MODE"
+#define ENV_FLASH_SNAPSHOT "TREZOR_FLASH_SNAPSHOT"
+#define ENV_RANDOM_FILE "TREZOR_RANDOM_FILE"
+
 #ifndef RANDOM_DEV_FILE
 #define RANDOM_DEV_FILE "/dev/urandom"
 #endif
 
 uint8_t *emulator_flash_base = NULL;
 
+/*
+ * Flash durability modes (selected by TREZOR_FLASH_MODE):
+ *
+ *  sync   - written ranges are msync'ed synchronously whenever the flash
+ *           is locked again, i.e. at every storage commit (default)
+ *  async  - written ranges are scheduled for writeback at commit points,
+ *           survives an emulator crash but not a host power loss
+ *  memory - flash lives in anonymous memory only and is never persisted
+ *
+ * Loading a snapshot, at startup or by emulatorFlashRestore, switches to
+ * memory for the rest of the run.
+ */
+enum {
+  FLASH_MODE_SYNC,
+  FLASH_MODE_ASYNC,
+  FLASH_MODE_MEMORY,
+};
+
+static int flash_mode = FLASH_MODE_SYNC;
+
+/* Range of the flash mapping written since the last commit */
+static size_t flash_dirty_start = FLASH_TOTAL_SIZE;
+static size_t flash_dirty_end = 0;
+
+/* File holding the flash snapshot that restores map copy-on-write */
+static int flash_snapshot_fd = -1;
+static bool flash_snapshot_loaded = false;
+
+/* Flash handed over by an embedding host instead of the emulation file */
+static bool flash_attached = false;
+static uint8_t *flash_buffer = NULL;
+
 uint32_t __stack_chk_guard;
 
+/* Source of emulatorRandom, TREZOR_RANDOM_FILE overrides RANDOM_DEV_FILE */
+static const char *random_file = RANDOM_DEV_FILE;
 static int random_fd = -1;
 
 static void setup_urandom(void);
@@ -61,7 +101,12 @@ void emulatorRandom(void *buffer, size_t size) {
   do {
     n = read(random_fd, (char *)buffer + len, size - len);
     if (n < 0) {
-      perror("Failed to read " RANDOM_DEV_FILE);
+      fprintf(stderr, "Failed to read %s: %s\n", random_file, strerror(errno));
+      exit(1);
+    }
+    if (n == 0) {
+      // a regular file ran out, there is no more randomness to hand out
+      fprintf(stderr, "Failed to read %s: end of file\n", random_file);
       exit(1);
     }
     len += n;
@@ -69,15 +114,197 @@ void emulatorRandom(void *buffer, size_t size) {
 }
 
 static void setup_urandom(void) {
-  random_fd = open(RANDOM_DEV_FILE, O_RDONLY);
+  const char *variable = getenv(ENV_RANDOM_FILE);
+  if (variable && *variable) {
+    random_file = variable;
+  }
+  random_fd = open(random_file, O_RDONLY);
   if (random_fd < 0) {
-    perror("Failed to open " RANDOM_DEV_FILE);
+    fprintf(stderr, "Failed to open %s: %s\n", random_file, strerror(errno));
+    exit(1);
+  }
+}
+
+void emulatorFlashDirty(const volatile void *ptr, size_t size) {
+  size_t start = (const volatile uint8_t *)ptr - emulator_flash_base;
+  if (start >= FLASH_TOTAL_SIZE) {
+    return;
+  }
+  size_t end = MIN(start + size, (size_t)FLASH_TOTAL_SIZE);
+
+  if (start < flash_dirty_start) {
+    flash_dirty_start = start;
+  }
+  if (end > flash_dirty_end) {
+    flash_dirty_end = end;
+  }
+}
+
+void emulatorFlashCommit(void) {
+  if (flash_dirty_start >= flash_dirty_end) {
+    return;
+  }
+
+  if (flash_mode != FLASH_MODE_MEMORY) {
+    // msync requires a page aligned address
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = flash_dirty_start & ~(page - 1);
+    int flags = (flash_mode == FLASH_MODE_SYNC) ? MS_SYNC : MS_ASYNC;
+    if (msync(emulator_flash_base + start, flash_dirty_end - start, flags) !=
+        0) {
+      perror("Failed to sync flash emulation file");
+      exit(1);
+    }
+  }
+
+  flash_dirty_start = FLASH_TOTAL_SIZE;
+  flash_dirty_end = 0;
+}
+
+static void map_flash_snapshot(void) {
+  void *base = mmap(emulator_flash_base, FLASH_TOTAL_SIZE,
+                    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                    flash_snapshot_fd, 0);
+  if (base == MAP_FAILED) {
+    perror("Failed to map flash snapshot");
+    exit(1);
+  }
+
+  // the flash is detached from the emulation file from now on
+  if (flash_mode != FLASH_MODE_MEMORY) {
+    fprintf(stderr, "Flash restored from snapshot, " EMULATOR_FLASH_FILE
+                    " is no longer written\n");
+  }
+  flash_mode = FLASH_MODE_MEMORY;
+  flash_dirty_start = FLASH_TOTAL_SIZE;
+  flash_dirty_end = 0;
+}
+
+void emulatorFlashSnapshot(void) {
+  FILE *file = tmpfile();
+  if (file == NULL) {
+    perror("Failed to create flash snapshot");
+    exit(1);
+  }
+
+  if (fwrite(emulator_flash_base, FLASH_TOTAL_SIZE, 1, file) != 1 ||
+      fflush(file) != 0) {
+    perror("Failed to write flash snapshot");
+    exit(1);
+  }
+
+  // existing mappings keep their own reference to the old snapshot
+  if (flash_snapshot_fd >= 0) {
+    close(flash_snapshot_fd);
+  }
+  flash_snapshot_fd = dup(fileno(file));
+  fclose(file);
+  if (flash_snapshot_fd < 0) {
+    perror("Failed to keep flash snapshot");
+    exit(1);
+  }
+}
+
+bool emulatorFlashRestore(void) {
+  if (flash_snapshot_fd < 0) {
+    return false;
+  }
+
+  // the host owns its buffer, so it cannot be remapped
+  if (flash_buffer) {
+    if (pread(flash_snapshot_fd, flash_buffer, FLASH_TOTAL_SIZE, 0) !=
+        FLASH_TOTAL_SIZE) {
+      perror("Failed to read flash snapshot");
+      exit(1);
+    }
+    flash_dirty_start = FLASH_TOTAL_SIZE;
+    flash_dirty_end = 0;
+    return true;
+  }
+
+  map_flash_snapshot();
+  return true;
+}
+
+bool emulatorFlashSnapshotLoaded(void) { return flash_snapshot_loaded; }
+
+void emulatorFlashAttach(uint8_t *buffer) {
+  flash_attached = true;
+  flash_buffer = buffer;
+}
+
+static void setup_flash_snapshot(const char *path) {
+  flash_snapshot_fd = open(path, O_RDONLY);
+  if (flash_snapshot_fd < 0) {
+    perror("Failed to open flash snapshot");
+    exit(1);
+  }
+
+  if (lseek(flash_snapshot_fd, 0, SEEK_END) != FLASH_TOTAL_SIZE) {
+    fprintf(stderr, "Flash snapshot %s has wrong size\n", path);
+    exit(1);
+  }
+
+  emulator_flash_base = mmap(NULL, FLASH_TOTAL_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE, flash_snapshot_fd, 0);
+  if (emulator_flash_base == MAP_FAILED) {
+    perror("Failed to map flash snapshot");
     exit(1);
   }
+
+  flash_mode = FLASH_MODE_MEMORY;
+  flash_snapshot_loaded = true;
+}
+
+static int emulatorFlashMode(void) {
+  const char *variable = getenv(ENV_FLASH_MODE);
+  if (!variable || strcmp(variable, "sync") == 0) {
+    return FLASH_MODE_SYNC;
+  }
+  if (strcmp(variable, "async") == 0) {
+    return FLASH_MODE_ASYNC;
+  }
+  if (strcmp(variable, "memory") == 0) {
+    return FLASH_MODE_MEMORY;
+  }
+  fprintf(stderr, "Unknown %s: %s\n", ENV_FLASH_MODE, variable);
+  exit(1);
 }
 
 static void setup_flash(void) {
-  int fd = open(EMULATOR_FLASH_FILE, O_RDWR | O_SYNC | O_CREAT, 0644);
+  if (flash_attached) {
+    flash_mode = FLASH_MODE_MEMORY;
+    // keep the state of the flash image passed by the host
+    if (flash_buffer) {
+      emulator_flash_base = flash_buffer;
+      flash_snapshot_loaded = true;
+      return;
+    }
+  } else {
+    flash_mode = emulatorFlashMode();
+
+    const char *snapshot = getenv(ENV_FLASH_SNAPSHOT);
+    if (snapshot) {
+      setup_flash_snapshot(snapshot);
+      return;
+    }
+  }
+
+  if (flash_mode == FLASH_MODE_MEMORY) {
+    emulator_flash_base = mmap(NULL, FLASH_TOTAL_SIZE, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (emulator_flash_base == MAP_FAILED) {
+      perror("Failed to map flash emulation memory");
+      exit(1);
+    }
+
+    /* Initialize the flash */
+    flash_erase_all_sectors(FLASH_CR_PROGRAM_X32);
+    emulatorFlashCommit();
+    return;
+  }
+
+  int fd = open(EMULATOR_FLASH_FILE, O_RDWR | O_CREAT, 0644);
   if (fd < 0) {
     perror("Failed to open flash emulation file");
     exit(1);
@@ -104,5 +331,6 @@ static void setup_flash(void) {
 
     /* Initialize the flash */
     flash_erase_all_sectors(FLASH_CR_PROGRAM_X32);
+    emulatorFlashCommit();
   }
 }
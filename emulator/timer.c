@@ -17,13 +17,43 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdbool.h>
+#include <stdlib.h>
 #include <time.h>
 
 #include "timer.h"
 
+#define ENV_VIRTUAL_TIME "TREZOR_VIRTUAL_TIME"
+
+/* In virtual time mode the clock only moves when the firmware sleeps
+ * or when DebugLink advances it, which keeps time dependent flows
+ * deterministic and lets them finish instantly. */
+static uint32_t virtual_ms = 0;
+static int virtual_enabled = -1;
+
+static bool emulatorVirtualTime(void) {
+  if (virtual_enabled < 0) {
+    const char *variable = getenv(ENV_VIRTUAL_TIME);
+    virtual_enabled = variable ? atoi(variable) != 0 : 0;
+  }
+  return virtual_enabled;
+}
+
+void emulatorSetVirtualTime(bool enabled) { virtual_enabled = enabled; }
+
+void emulatorAdvanceTime(uint32_t millis) {
+  if (emulatorVirtualTime()) {
+    virtual_ms += millis;
+  }
+}
+
 void timer_init(void) {}
 
 uint32_t timer_ms(void) {
+  if (emulatorVirtualTime()) {
+    return virtual_ms;
+  }
+
   struct timespec t;
   clock_gettime(CLOCK_MONOTONIC, &t);
 
@@ -19,13 +19,36 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <time.h>
 
 #define TREZOR_UDP_PORT 21324
 
+#define ENV_WIRE_RECORD "TREZOR_WIRE_RECORD"
+#define ENV_WIRE_REPLAY "TREZOR_WIRE_REPLAY"
+
+// Wire logs start with WIRE_MAGIC, followed by one record per report: the
+// time since the previous record in microseconds (uint32_t, little endian),
+// a flags byte with the interface and direction, the report length and the
+// report itself.
+static const char WIRE_MAGIC[8] = {'T', 'R', 'Z', 'W', 'I', 'R', 'E', '1'};
+
+#define WIRE_IFACE_DEBUG 0x01
+#define WIRE_DEVICE_OUT 0x02
+
+// give up on a replay when the firmware does not make progress
+#define WIRE_REPLAY_STALL_US (10 * 1000 * 1000)
+
+struct wire_report {
+  uint8_t flags;
+  uint8_t size;
+  uint8_t data[64];
+};
+
 struct usb_socket {
   int fd;
   struct sockaddr_in from;
@@ -35,6 +58,156 @@ struct usb_socket {
 static struct usb_socket usb_main;
 static struct usb_socket usb_debug;
 
+static FILE *wire_record = NULL;
+static uint64_t wire_record_last = 0;
+
+static struct wire_report *wire_replay = NULL;
+static size_t wire_replay_count = 0;
+static size_t wire_replay_in = 0, wire_replay_out = 0;
+static size_t wire_replay_diffs = 0, wire_replay_outputs = 0;
+static uint64_t wire_replay_start = 0, wire_replay_progress = 0;
+
+static uint64_t wire_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void wire_record_report(uint8_t flags, const void *buffer,
+                               size_t size) {
+  uint64_t now = wire_now();
+  uint64_t delta = now - wire_record_last;
+  if (delta > UINT32_MAX) {
+    delta = UINT32_MAX;
+  }
+  wire_record_last = now;
+
+  uint8_t header[6] = {delta & 0xFF,         (delta >> 8) & 0xFF,
+                       (delta >> 16) & 0xFF, (delta >> 24) & 0xFF,
+                       flags,                size};
+  if (fwrite(header, sizeof(header), 1, wire_record) != 1 ||
+      fwrite(buffer, size, 1, wire_record) != 1 || fflush(wire_record) != 0) {
+    perror("Failed to write " ENV_WIRE_RECORD);
+    fclose(wire_record);
+    wire_record = NULL;
+  }
+}
+
+static void wire_record_setup(const char *path) {
+  wire_record = fopen(path, "wb");
+  if (!wire_record) {
+    perror("Failed to open " ENV_WIRE_RECORD);
+    exit(1);
+  }
+  fwrite(WIRE_MAGIC, sizeof(WIRE_MAGIC), 1, wire_record);
+  wire_record_last = wire_now();
+}
+
+static void wire_replay_setup(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror("Failed to open " ENV_WIRE_REPLAY);
+    exit(1);
+  }
+  char magic[sizeof(WIRE_MAGIC)];
+  if (fread(magic, sizeof(magic), 1, f) != 1 ||
+      memcmp(magic, WIRE_MAGIC, sizeof(magic)) != 0) {
+    fprintf(stderr, "%s is not a wire log\n", path);
+    exit(1);
+  }
+
+  size_t capacity = 0;
+  uint8_t header[6];
+  while (fread(header, sizeof(header), 1, f) == 1) {
+    if (wire_replay_count == capacity) {
+      capacity = capacity ? 2 * capacity : 256;
+      wire_replay = realloc(wire_replay, capacity * sizeof(*wire_replay));
+      if (!wire_replay) {
+        perror("Failed to load " ENV_WIRE_REPLAY);
+        exit(1);
+      }
+    }
+    struct wire_report *report = &wire_replay[wire_replay_count];
+    report->flags = header[4];
+    report->size = header[5];
+    if (report->size > sizeof(report->data) ||
+        fread(report->data, report->size, 1, f) != 1) {
+      fprintf(stderr, "%s is truncated\n", path);
+      exit(1);
+    }
+    wire_replay_count++;
+  }
+  fclose(f);
+
+  wire_replay_start = wire_replay_progress = wire_now();
+}
+
+static size_t wire_replay_next(size_t pos, uint8_t direction) {
+  while (pos < wire_replay_count &&
+         (wire_replay[pos].flags & WIRE_DEVICE_OUT) != direction) {
+    pos++;
+  }
+  return pos;
+}
+
+static void wire_replay_check_done(void) {
+  uint64_t now = wire_now();
+  bool done = wire_replay_in == wire_replay_count &&
+              wire_replay_out == wire_replay_count;
+  if (!done && now - wire_replay_progress < WIRE_REPLAY_STALL_US) {
+    return;
+  }
+  if (!done) {
+    fprintf(stderr, "Replay stalled at report %zu of %zu\n",
+            wire_replay_in < wire_replay_out ? wire_replay_in : wire_replay_out,
+            wire_replay_count);
+  }
+  printf("Replayed %zu reports in %.3f ms, %zu of %zu responses differ\n",
+         wire_replay_count, (now - wire_replay_start) / 1000.0,
+         wire_replay_diffs, wire_replay_outputs);
+  exit(done && wire_replay_diffs == 0 ? 0 : 1);
+}
+
+// feed the next recorded input once every response recorded before it has
+// been produced, so the firmware sees the same conversation as before
+static size_t wire_replay_read(int *iface, void *buffer, size_t size) {
+  wire_replay_in = wire_replay_next(wire_replay_in, 0);
+  wire_replay_out = wire_replay_next(wire_replay_out, WIRE_DEVICE_OUT);
+  wire_replay_check_done();
+  if (wire_replay_in == wire_replay_count ||
+      wire_replay_out < wire_replay_in) {
+    return 0;
+  }
+
+  const struct wire_report *report = &wire_replay[wire_replay_in++];
+  *iface = (report->flags & WIRE_IFACE_DEBUG) ? 1 : 0;
+  if (size > report->size) {
+    size = report->size;
+  }
+  memcpy(buffer, report->data, size);
+  wire_replay_progress = wire_now();
+  return size;
+}
+
+static size_t wire_replay_write(int iface, const void *buffer, size_t size) {
+  wire_replay_outputs++;
+  wire_replay_out = wire_replay_next(wire_replay_out, WIRE_DEVICE_OUT);
+  if (wire_replay_out == wire_replay_count) {
+    fprintf(stderr, "Unexpected response on interface %d\n", iface);
+    wire_replay_diffs++;
+    return size;
+  }
+  const struct wire_report *report = &wire_replay[wire_replay_out++];
+  if ((report->flags & WIRE_IFACE_DEBUG) != (iface ? WIRE_IFACE_DEBUG : 0) ||
+      report->size != size || memcmp(report->data, buffer, size) != 0) {
+    fprintf(stderr, "Response %zu differs from the recording\n",
+            wire_replay_outputs);
+    wire_replay_diffs++;
+  }
+  wire_replay_progress = wire_now();
+  return size;
+}
+
 static int socket_setup(int port) {
   int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
   if (fd < 0) {
@@ -94,6 +267,17 @@ static size_t socket_read(struct usb_socket *sock, void *buffer, size_t size) {
 }
 
 void emulatorSocketInit(void) {
+  const char *replay = getenv(ENV_WIRE_REPLAY);
+  if (replay) {
+    wire_replay_setup(replay);
+    return;
+  }
+
+  const char *record = getenv(ENV_WIRE_RECORD);
+  if (record) {
+    wire_record_setup(record);
+  }
+
   usb_main.fd = socket_setup(TREZOR_UDP_PORT);
   usb_main.fromlen = 0;
   usb_debug.fd = socket_setup(TREZOR_UDP_PORT + 1);
@@ -101,22 +285,56 @@ void emulatorSocketInit(void) {
 }
 
 size_t emulatorSocketRead(int *iface, void *buffer, size_t size) {
+  if (wire_replay) {
+    return wire_replay_read(iface, buffer, size);
+  }
+
   size_t n = socket_read(&usb_main, buffer, size);
   if (n > 0) {
     *iface = 0;
-    return n;
+  } else {
+    n = socket_read(&usb_debug, buffer, size);
+    if (n > 0) {
+      *iface = 1;
+    }
   }
 
-  n = socket_read(&usb_debug, buffer, size);
-  if (n > 0) {
-    *iface = 1;
-    return n;
+  if (n > 0 && wire_record) {
+    wire_record_report(*iface ? WIRE_IFACE_DEBUG : 0, buffer, n);
   }
+  return n;
+}
 
-  return 0;
+/* Block until a report can be read or millis pass */
+bool emulatorSocketWait(uint32_t millis) {
+  // replayed reports are released by emulatorSocketRead alone
+  if (wire_replay) {
+    return false;
+  }
+
+  struct pollfd fds[] = {
+      {.fd = usb_main.fd, .events = POLLIN},
+      {.fd = usb_debug.fd, .events = POLLIN},
+  };
+  return poll(fds, sizeof(fds) / sizeof(fds[0]), millis) > 0;
+}
+
+/* Datagrams are sent right away, so a report is never held back */
+bool emulatorSocketWritable(int iface) {
+  (void)iface;
+  return true;
 }
 
 size_t emulatorSocketWrite(int iface, const void *buffer, size_t size) {
+  if (wire_replay) {
+    return wire_replay_write(iface, buffer, size);
+  }
+
+  if (wire_record && (iface == 0 || iface == 1)) {
+    wire_record_report(WIRE_DEVICE_OUT | (iface ? WIRE_IFACE_DEBUG : 0),
+                       buffer, size);
+  }
+
   if (iface == 0) {
     return socket_write(&usb_main, buffer, size);
   }
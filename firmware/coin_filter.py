@@ -0,0 +1,13 @@
+# Coins built into the firmware, shared by coin_info.c.mako and
+# coin_info.h.mako so that the table and its length always agree.
+
+import os
+
+# BITCOIN_ONLY=1 keeps Bitcoin and its testnets
+BITCOIN_ONLY_COINS = ("BTC", "TEST", "REGTEST")
+
+
+def firmware_coins(coins):
+    if os.environ.get("BITCOIN_ONLY") == "1":
+        coins = [c for c in coins if c.coin_shortcut in BITCOIN_ONLY_COINS]
+    return list(coins)
@@ -1,4 +1,9 @@
 <%
+from coin_filter import firmware_coins
+
+def coins_list():
+	return firmware_coins(supported_on("trezor1", bitcoin))
+
 def signed_message_header(s):
 	return r'"\x{:02x}" {}'.format(len(s), c_str(s))
 
@@ -23,7 +28,7 @@ def hex(x):
 #include "secp256k1.h"
 
 const CoinInfo coins[COINS_COUNT] = {
-% for c in supported_on("trezor1", bitcoin):
+% for c in coins_list():
 {
 	.coin_name = ${c_str(c.coin_name)},
 	.coin_shortcut = ${c_str(" " + c.coin_shortcut)},
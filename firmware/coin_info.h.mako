@@ -6,7 +6,11 @@
 
 #include "coins.h"
 
-<% coins_list = list(supported_on("trezor1", bitcoin)) %>\
+<%
+from coin_filter import firmware_coins
+
+coins_list = firmware_coins(supported_on("trezor1", bitcoin))
+%>\
 #define COINS_COUNT (${len(coins_list)})
 
 extern const CoinInfo coins[COINS_COUNT];
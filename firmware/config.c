@@ -30,6 +30,7 @@
 #include "config.h"
 #include "curves.h"
 #include "debug.h"
+#include "drbg.h"
 #include "gettext.h"
 #include "hmac.h"
 #include "layout2.h"
@@ -41,6 +42,7 @@
 #include "sha2.h"
 #include "storage.h"
 #include "supervise.h"
+#include "task.h"
 #include "trezor.h"
 #include "u2f.h"
 #include "usb.h"
@@ -128,6 +130,24 @@ static char CONFIDENTIAL sessionPassphrase[51];
 static secbool autoLockDelayMsCached = secfalse;
 static uint32_t autoLockDelayMs = autoLockDelayMsDefault;
 
+/* storage_next_counter clears one bit of the counter tail in place and
+ * appends a new norcow entry only when the tail runs out, once in
+ * U2F_COUNTER_TAIL increments. The first U2F_COUNTER_TAIL authentications
+ * after boot use it directly, so short sessions wear the flash exactly as
+ * before. Longer sessions reserve blocks of U2F_COUNTER_BLOCK values with
+ * one storage_set_counter append each and serve them from RAM. The block is
+ * several tails long, so this appends less often than counting in place.
+ * The stored counter is always at least the largest value handed out, so it
+ * stays strictly increasing across power loss, skipping at most the rest of
+ * a block.
+ */
+#define U2F_COUNTER_TAIL 64
+#define U2F_COUNTER_BLOCK (4 * U2F_COUNTER_TAIL)
+static uint32_t u2fCounterInPlace = 0;
+static secbool u2fCounterCached = secfalse;
+static uint32_t u2fCounterNext = 0;
+static uint32_t u2fCounterLimit = 0;
+
 static const uint32_t CONFIG_VERSION = 11;
 
 static const uint8_t FALSE_BYTE = '\x00';
@@ -383,6 +403,8 @@ void config_init(void) {
 
   storage_init(&protectPinUiCallback, HW_ENTROPY_DATA, HW_ENTROPY_LEN);
   memzero(HW_ENTROPY_DATA, sizeof(HW_ENTROPY_DATA));
+  u2fCounterCached = secfalse;
+  u2fCounterInPlace = 0;
 
   // Auto-unlock storage if no PIN is set.
   if (storage_is_unlocked() == secfalse && storage_has_pin() == secfalse) {
@@ -560,6 +582,7 @@ void config_setHomescreen(const uint8_t *data, uint32_t size) {
 
 static void get_root_node_callback(uint32_t iter, uint32_t total) {
   usbSleep(1);
+  task_yield();
   layoutProgress(_("Waking up"), 1000 * iter / total);
 }
 
@@ -886,12 +909,35 @@ bool config_getFlags(uint32_t *flags) {
 }
 
 uint32_t config_nextU2FCounter(void) {
-  uint32_t u2fcounter = 0;
-  storage_next_counter(KEY_U2F_COUNTER, &u2fcounter);
-  return u2fcounter;
+  if (sectrue != u2fCounterCached) {
+    // Continue after anything that might have been handed out before.
+    uint32_t u2fcounter = 0;
+    if (sectrue != storage_next_counter(KEY_U2F_COUNTER, &u2fcounter) ||
+        ++u2fCounterInPlace < U2F_COUNTER_TAIL) {
+      return u2fcounter;
+    }
+    u2fCounterNext = u2fcounter + 1;
+    u2fCounterLimit = u2fcounter;
+    u2fCounterCached = sectrue;
+    return u2fcounter;
+  }
+
+  if (u2fCounterNext > u2fCounterLimit) {
+    // Reserve the next block before handing out any value from it.
+    uint32_t limit = u2fCounterNext + U2F_COUNTER_BLOCK - 1;
+    if (sectrue != storage_set_counter(KEY_U2F_COUNTER, limit)) {
+      u2fCounterCached = secfalse;
+      return 0;
+    }
+    u2fCounterLimit = limit;
+  }
+
+  return u2fCounterNext++;
 }
 
 void config_setU2FCounter(uint32_t u2fcounter) {
+  u2fCounterCached = secfalse;
+  u2fCounterInPlace = 0;
   storage_set_counter(KEY_U2F_COUNTER, u2fcounter);
 }
 
@@ -922,6 +968,7 @@ void config_setAutoLockDelayMs(uint32_t auto_lock_delay_ms) {
 }
 
 void config_wipe(void) {
+  drbg_wipe();
   char oldTiny = usbTiny(1);
   storage_wipe();
   if (storage_is_unlocked() != sectrue) {
@@ -931,6 +978,8 @@ void config_wipe(void) {
   random_buffer((uint8_t *)config_uuid, sizeof(config_uuid));
   data2hex(config_uuid, sizeof(config_uuid), config_uuid_str);
   autoLockDelayMsCached = secfalse;
+  u2fCounterCached = secfalse;
+  u2fCounterInPlace = 0;
   storage_set(KEY_UUID, config_uuid, sizeof(config_uuid));
   storage_set(KEY_VERSION, &CONFIG_VERSION, sizeof(CONFIG_VERSION));
   session_clear(false);
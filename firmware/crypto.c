@@ -110,26 +110,24 @@ int gpgMessageSign(HDNode *node, const uint8_t *message, size_t message_len,
   }
 }
 
-static void cryptoMessageHash(const CoinInfo *coin, const uint8_t *message,
-                              size_t message_len,
-                              uint8_t hash[HASHER_DIGEST_LENGTH]) {
-  Hasher hasher;
-  hasher_Init(&hasher, coin->curve->hasher_sign);
-  hasher_Update(&hasher, (const uint8_t *)coin->signed_message_header,
+void cryptoMessageHashInit(const CoinInfo *coin, uint32_t message_len,
+                           Hasher *hasher) {
+  hasher_Init(hasher, coin->curve->hasher_sign);
+  hasher_Update(hasher, (const uint8_t *)coin->signed_message_header,
                 strlen(coin->signed_message_header));
-  uint8_t varint[5];
-  uint32_t l = ser_length(message_len, varint);
-  hasher_Update(&hasher, varint, l);
+  ser_length_hash(hasher, message_len);
+}
+
+void cryptoMessageHash(const CoinInfo *coin, const uint8_t *message,
+                       size_t message_len, uint8_t hash[HASHER_DIGEST_LENGTH]) {
+  Hasher hasher;
+  cryptoMessageHashInit(coin, message_len, &hasher);
   hasher_Update(&hasher, message, message_len);
   hasher_Final(&hasher, hash);
 }
 
-int cryptoMessageSign(const CoinInfo *coin, HDNode *node,
-                      InputScriptType script_type, const uint8_t *message,
-                      size_t message_len, uint8_t *signature) {
-  uint8_t hash[HASHER_DIGEST_LENGTH];
-  cryptoMessageHash(coin, message, message_len, hash);
-
+int cryptoMessageSignDigest(HDNode *node, InputScriptType script_type,
+                            const uint8_t *hash, uint8_t *signature) {
   uint8_t pby;
   int result = hdnode_sign_digest(node, hash, signature + 1, &pby, NULL);
   if (result == 0) {
@@ -151,26 +149,38 @@ int cryptoMessageSign(const CoinInfo *coin, HDNode *node,
   return result;
 }
 
-int cryptoMessageVerify(const CoinInfo *coin, const uint8_t *message,
-                        size_t message_len, const char *address,
-                        const uint8_t *signature) {
+int cryptoMessageSign(const CoinInfo *coin, HDNode *node,
+                      InputScriptType script_type, const uint8_t *message,
+                      size_t message_len, uint8_t *signature) {
+  uint8_t hash[HASHER_DIGEST_LENGTH];
+  cryptoMessageHash(coin, message, message_len, hash);
+  return cryptoMessageSignDigest(node, script_type, hash, signature);
+}
+
+int cryptoMessageRecover(const CoinInfo *coin, const uint8_t *hash,
+                         const uint8_t *signature, uint8_t pubkey[65]) {
   // check for invalid signature prefix
   if (signature[0] < 27 || signature[0] > 43) {
     return 1;
   }
 
-  uint8_t hash[HASHER_DIGEST_LENGTH];
-  cryptoMessageHash(coin, message, message_len, hash);
-
   uint8_t recid = (signature[0] - 27) % 4;
-  bool compressed = signature[0] >= 31;
 
   // check if signature verifies the digest and recover the public key
-  uint8_t pubkey[65];
   if (ecdsa_recover_pub_from_sig(coin->curve->params, pubkey, signature + 1,
                                  hash, recid) != 0) {
     return 3;
   }
+  return 0;
+}
+
+int cryptoMessageCheckAddress(const CoinInfo *coin, const char *address,
+                              const uint8_t *signature,
+                              const uint8_t recovered[65]) {
+  bool compressed = signature[0] >= 31;
+
+  uint8_t pubkey[65];
+  memcpy(pubkey, recovered, sizeof(pubkey));
   // convert public key to compressed pubkey if necessary
   if (compressed) {
     pubkey[0] = 0x02 | (pubkey[64] & 1);
@@ -230,6 +240,20 @@ int cryptoMessageVerify(const CoinInfo *coin, const uint8_t *message,
   return 0;
 }
 
+int cryptoMessageVerify(const CoinInfo *coin, const uint8_t *message,
+                        size_t message_len, const char *address,
+                        const uint8_t *signature) {
+  uint8_t hash[HASHER_DIGEST_LENGTH];
+  cryptoMessageHash(coin, message, message_len, hash);
+
+  uint8_t pubkey[65];
+  int result = cryptoMessageRecover(coin, hash, signature, pubkey);
+  if (result != 0) {
+    return result;
+  }
+  return cryptoMessageCheckAddress(coin, address, signature, pubkey);
+}
+
 /* ECIES disabled
 int cryptoMessageEncrypt(curve_point *pubkey, const uint8_t *msg, size_t
 msg_size, bool display_only, uint8_t *nonce, size_t *nonce_len, uint8_t
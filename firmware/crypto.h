@@ -44,10 +44,28 @@ int sshMessageSign(HDNode *node, const uint8_t *message, size_t message_len,
 int gpgMessageSign(HDNode *node, const uint8_t *message, size_t message_len,
                    uint8_t *signature);
 
+// starts the hash SignMessage signs, the message itself is added by the caller
+void cryptoMessageHashInit(const CoinInfo *coin, uint32_t message_len,
+                           Hasher *hasher);
+
+void cryptoMessageHash(const CoinInfo *coin, const uint8_t *message,
+                       size_t message_len, uint8_t hash[HASHER_DIGEST_LENGTH]);
+
+int cryptoMessageSignDigest(HDNode *node, InputScriptType script_type,
+                            const uint8_t *hash, uint8_t *signature);
+
 int cryptoMessageSign(const CoinInfo *coin, HDNode *node,
                       InputScriptType script_type, const uint8_t *message,
                       size_t message_len, uint8_t *signature);
 
+// cryptoMessageVerify split in two, the recovered key is uncompressed
+int cryptoMessageRecover(const CoinInfo *coin, const uint8_t *hash,
+                         const uint8_t *signature, uint8_t pubkey[65]);
+
+int cryptoMessageCheckAddress(const CoinInfo *coin, const char *address,
+                              const uint8_t *signature,
+                              const uint8_t recovered[65]);
+
 int cryptoMessageVerify(const CoinInfo *coin, const uint8_t *message,
                         size_t message_len, const char *address,
                         const uint8_t *signature);
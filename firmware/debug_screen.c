@@ -0,0 +1,105 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "debug_screen.h"
+#include <string.h>
+#include "memzero.h"
+#include "messages-bitkey.pb.h"
+#include "messages.h"
+#include "oled.h"
+
+#if DEBUG_LINK
+
+#define SCREEN_PAGES (OLED_HEIGHT / 8)
+
+_Static_assert(sizeof(((DebugLinkScreen *)0)->pages) /
+                       sizeof(((DebugLinkScreen *)0)->pages[0]) >=
+                   SCREEN_PAGES,
+               "DebugLinkScreen.pages too small");
+_Static_assert(sizeof(((DebugLinkScreenPage *)0)->data.bytes) >= OLED_WIDTH,
+               "DebugLinkScreenPage.data too small");
+
+static bool watching = false;
+// a refresh happened that was not sent yet
+static bool pending;
+// the host has a copy of sent
+static bool sent_valid;
+static uint32_t frame, shown_frame;
+static uint8_t shown[OLED_BUFSIZE];
+static uint8_t sent[OLED_BUFSIZE];
+// not in the scratch arena, usbPoll also runs while a message that spans
+// several reports is assembled there
+static DebugLinkScreen resp;
+
+static void debug_screen_refreshed(const uint8_t *buf) {
+  frame++;
+  if (watching) {
+    memcpy(shown, buf, OLED_BUFSIZE);
+    shown_frame = frame;
+    pending = true;
+  }
+}
+
+void debug_screen_init(void) { oledSetRefreshHook(debug_screen_refreshed); }
+
+void debug_screen_watch(bool watch) {
+  watching = watch;
+  sent_valid = false;
+  pending = watch;
+  if (watch) {
+    // start with what is on the display now
+    memcpy(shown, oledGetBuffer(), OLED_BUFSIZE);
+    shown_frame = frame;
+  }
+}
+
+void debug_screen_poll(void) {
+  // refreshes are merged until the previous frame is out, msg_debug_write
+  // does not check for room in the queue
+  if (!watching || !pending || !msg_debug_out_empty()) {
+    return;
+  }
+  pending = false;
+
+  memzero(&resp, sizeof(resp));
+
+  for (int i = 0; i < SCREEN_PAGES; i++) {
+    const uint8_t *page = shown + i * OLED_WIDTH;
+    if (sent_valid && memcmp(page, sent + i * OLED_WIDTH, OLED_WIDTH) == 0) {
+      continue;
+    }
+    DebugLinkScreenPage *p = &resp.pages[resp.pages_count++];
+    p->has_index = true;
+    p->index = i;
+    p->has_data = true;
+    p->data.size = OLED_WIDTH;
+    memcpy(p->data.bytes, page, OLED_WIDTH);
+  }
+
+  if (resp.pages_count > 0) {
+    resp.has_frame = true;
+    resp.frame = shown_frame;
+    if (msg_debug_write(BitkeyMessageType_MessageType_DebugLinkScreen, &resp)) {
+      memcpy(sent, shown, OLED_BUFSIZE);
+      sent_valid = true;
+    }
+  }
+}
+
+#endif
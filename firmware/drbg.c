@@ -0,0 +1,131 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "chacha20poly1305/ecrypt-sync.h"
+#include "drbg.h"
+#include "memzero.h"
+#include "rng.h"
+
+#define DRBG_KEY_SIZE 32
+#define DRBG_NONCE_SIZE 8
+#define DRBG_SEED_SIZE (DRBG_KEY_SIZE + DRBG_NONCE_SIZE)
+#define DRBG_BLOCK_SIZE 64
+// the first DRBG_SEED_SIZE bytes of every refill become the next key
+#define DRBG_BUFFER_SIZE (4 * DRBG_BLOCK_SIZE)
+
+static CONFIDENTIAL ECRYPT_ctx drbg_ctx;
+static CONFIDENTIAL uint8_t drbg_buffer[DRBG_BUFFER_SIZE];
+// unserved bytes at the end of drbg_buffer
+static size_t drbg_left = 0;
+static size_t drbg_served = 0;
+static bool drbg_seeded = false;
+
+static void drbg_entropy(uint8_t *seed) {
+#if EMULATOR
+  emulatorRandom(seed, DRBG_SEED_SIZE);
+#else
+  for (size_t i = 0; i < DRBG_SEED_SIZE; i += sizeof(uint32_t)) {
+    uint32_t r = random32();
+    memcpy(seed + i, &r, sizeof(r));
+  }
+#endif
+}
+
+static void drbg_rekey(const uint8_t *seed) {
+  ECRYPT_keysetup(&drbg_ctx, seed, DRBG_KEY_SIZE * 8, DRBG_NONCE_SIZE * 8);
+  ECRYPT_ivsetup(&drbg_ctx, seed + DRBG_KEY_SIZE);
+}
+
+static void drbg_refill(void) {
+  ECRYPT_keystream_bytes(&drbg_ctx, drbg_buffer, DRBG_BUFFER_SIZE);
+  if (drbg_served >= DRBG_RESEED_INTERVAL) {
+    uint8_t seed[DRBG_SEED_SIZE];
+    drbg_entropy(seed);
+    for (size_t i = 0; i < DRBG_SEED_SIZE; i++) {
+      drbg_buffer[i] ^= seed[i];
+    }
+    memzero(seed, sizeof(seed));
+    drbg_served = 0;
+  }
+  drbg_rekey(drbg_buffer);
+  memzero(drbg_buffer, DRBG_SEED_SIZE);
+  drbg_left = DRBG_BUFFER_SIZE - DRBG_SEED_SIZE;
+}
+
+static void drbg_take(uint8_t *buf, size_t len) {
+  uint8_t *p = drbg_buffer + DRBG_BUFFER_SIZE - drbg_left;
+  memcpy(buf, p, len);
+  memzero(p, len);
+  drbg_left -= len;
+  drbg_served += len;
+}
+
+void drbg_wipe(void) {
+  memzero(&drbg_ctx, sizeof(drbg_ctx));
+  memzero(drbg_buffer, sizeof(drbg_buffer));
+  drbg_left = 0;
+  drbg_served = 0;
+  drbg_seeded = false;
+}
+
+void drbg_reseed(void) {
+  // nothing of the old key or keystream survives, the next request seeds a
+  // new key from hardware entropy alone
+  drbg_wipe();
+}
+
+// overrides the weak definition in rand.c, which calls random32 per word
+void random_buffer(uint8_t *buf, size_t len) {
+  if (!drbg_seeded) {
+    uint8_t seed[DRBG_SEED_SIZE];
+    drbg_entropy(seed);
+    drbg_rekey(seed);
+    memzero(seed, sizeof(seed));
+    drbg_seeded = true;
+  }
+  if (drbg_left == 0 || drbg_served >= DRBG_RESEED_INTERVAL) {
+    drbg_refill();
+  }
+
+  size_t n = len < drbg_left ? len : drbg_left;
+  drbg_take(buf, n);
+  buf += n;
+  len -= n;
+
+  // bulk requests take whole blocks straight from the keystream, then the
+  // refill replaces the key that produced them
+  size_t bulk = len - len % DRBG_BLOCK_SIZE;
+  if (bulk > 0) {
+    ECRYPT_keystream_bytes(&drbg_ctx, buf, bulk);
+    drbg_served += bulk;
+    buf += bulk;
+    len -= bulk;
+    drbg_refill();
+  }
+
+  if (len > 0) {
+    if (drbg_left == 0) {
+      drbg_refill();
+    }
+    drbg_take(buf, len);
+  }
+}
@@ -0,0 +1,40 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DRBG_H__
+#define __DRBG_H__
+
+/*
+ * random_buffer (declared in rand.h) is served from a ChaCha20 keystream
+ * seeded from random32, which keeps running the continuous test of the
+ * hardware RNG. Fresh hardware entropy is mixed into the key after every
+ * DRBG_RESEED_INTERVAL bytes, and the key is replaced from the keystream
+ * on every refill, so bytes that were already served cannot be recomputed
+ * from a later state.
+ */
+
+#define DRBG_RESEED_INTERVAL 1024
+
+// seed a new key from hardware entropy before the next request is served
+void drbg_reseed(void);
+
+// wipe the key and the unserved keystream
+void drbg_wipe(void);
+
+#endif
@@ -40,6 +40,13 @@
 /* maximum supported chain id.  v must fit in an uint32_t. */
 #define MAX_CHAIN_ID 2147483629
 
+/* largest data chunk requested from the host.  The encoded EthereumTxAck
+ * (tag, two byte length and data) has to fit the receive buffer. */
+#define MAX_DATA_CHUNK (MSG_IN_SIZE - 8)
+_Static_assert(sizeof(((EthereumTxAck *)0)->data_chunk.bytes) >=
+                   MAX_DATA_CHUNK,
+               "EthereumTxAck.data_chunk max_size too small");
+
 static bool ethereum_signing = false;
 static uint32_t data_total, data_left;
 static EthereumTxRequest msg_tx_request;
@@ -172,7 +179,8 @@ static void send_request_chunk(void) {
                                               : data_left * 800 / data_total);
   layoutProgress(_("Signing"), progress);
   msg_tx_request.has_data_length = true;
-  msg_tx_request.data_length = data_left <= 1024 ? data_left : 1024;
+  msg_tx_request.data_length =
+      data_left <= MAX_DATA_CHUNK ? data_left : MAX_DATA_CHUNK;
   msg_write(MessageType_MessageType_EthereumTxRequest, &msg_tx_request);
 }
 
@@ -627,47 +635,7 @@ void ethereum_signing_abort(void) {
 static void ethereum_message_hash(const uint8_t *message, size_t message_len,
                                   uint8_t hash[32]) {
   struct SHA3_CTX ctx;
-  sha3_256_Init(&ctx);
-  sha3_Update(&ctx, (const uint8_t *)"\x19" "Ethereum Signed Message:\n", 26);
-  uint8_t c;
-  if (message_len > 1000000000) {
-    c = '0' + message_len / 1000000000 % 10;
-    sha3_Update(&ctx, &c, 1);
-  }
-  if (message_len > 100000000) {
-    c = '0' + message_len / 100000000 % 10;
-    sha3_Update(&ctx, &c, 1);
-  }
-  if (message_len > 10000000) {
-    c = '0' + message_len / 10000000 % 10;
-    sha3_Update(&ctx, &c, 1);
-  }
-  if (message_len > 1000000) {
-    c = '0' + message_len / 1000000 % 10;
-    sha3_Update(&ctx, &c, 1);
-  }
-  if (message_len > 100000) {
-    c = '0' + message_len / 100000 % 10;
-    sha3_Update(&ctx, &c, 1);
-  }
-  if (message_len > 10000) {
-    c = '0' + message_len / 10000 % 10;
-    sha3_Update(&ctx, &c, 1);
-  }
-  if (message_len > 1000) {
-    c = '0' + message_len / 1000 % 10;
-    sha3_Update(&ctx, &c, 1);
-  }
-  if (message_len > 100) {
-    c = '0' + message_len / 100 % 10;
-    sha3_Update(&ctx, &c, 1);
-  }
-  if (message_len > 10) {
-    c = '0' + message_len / 10 % 10;
-    sha3_Update(&ctx, &c, 1);
-  }
-  c = '0' + message_len % 10;
-  sha3_Update(&ctx, &c, 1);
+  ethereum_message_hash_init(&ctx, message_len);
   sha3_Update(&ctx, message, message_len);
   keccak_Final(&ctx, hash);
 }
@@ -701,6 +669,132 @@ void ethereum_message_sign(const EthereumSignMessage *msg, const HDNode *node,
   msg_write(MessageType_MessageType_EthereumMessageSignature, resp);
 }
 
+static bool ethereum_message_signing = false;
+static uint32_t message_total, message_left;
+// the preview showed only part of the message
+static bool message_show_digest;
+static char message_address[43];
+static CONFIDENTIAL uint8_t message_privkey[32];
+static struct SHA3_CTX message_ctx;
+
+static void send_message_request_chunk(void) {
+  int progress =
+      1000 - (message_total > 1000000 ? message_left / (message_total / 800)
+                                      : message_left * 800 / message_total);
+  layoutProgress(_("Signing"), progress);
+  EthereumSignMessageRequest request;
+  memzero(&request, sizeof(request));
+  request.has_data_length = true;
+  request.data_length = message_left <= 1024 ? message_left : 1024;
+  msg_write(BitkeyMessageType_MessageType_EthereumSignMessageRequest,
+            &request);
+}
+
+static void send_message_signature(void) {
+  uint8_t hash[32];
+  keccak_Final(&message_ctx, hash);
+
+  if (message_show_digest) {
+    layoutSignMessageDigest(hash);
+    if (!protectButton(ButtonRequestType_ButtonRequest_ProtectCall, false)) {
+      fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+      ethereum_message_signing_abort();
+      return;
+    }
+  }
+
+  layoutProgress(_("Signing"), 1000);
+  EthereumMessageSignature resp;
+  memzero(&resp, sizeof(resp));
+  uint8_t v;
+  if (ecdsa_sign_digest(&secp256k1, message_privkey, hash,
+                        resp.signature.bytes, &v, ethereum_is_canonic) != 0) {
+    fsm_sendFailure(FailureType_Failure_ProcessError, _("Signing failed"));
+    ethereum_message_signing_abort();
+    return;
+  }
+
+  resp.has_address = true;
+  strlcpy(resp.address, message_address, sizeof(resp.address));
+  resp.has_signature = true;
+  resp.signature.bytes[64] = 27 + v;
+  resp.signature.size = 65;
+  msg_write(MessageType_MessageType_EthereumMessageSignature, &resp);
+
+  ethereum_message_signing_abort();
+}
+
+void ethereum_message_signing_init(const EthereumSignMessageStream *msg,
+                                   const HDNode *node) {
+  uint8_t pubkeyhash[20];
+  if (!hdnode_get_ethereum_pubkeyhash(node, pubkeyhash)) {
+    fsm_sendFailure(FailureType_Failure_ProcessError,
+                    _("Failed to compute address"));
+    layoutHome();
+    return;
+  }
+  message_address[0] = '0';
+  message_address[1] = 'x';
+  ethereum_address_checksum(pubkeyhash, message_address + 2, false, 0);
+
+  ethereum_message_signing = true;
+  memcpy(message_privkey, node->private_key, 32);
+
+  // the length goes into the hash before the message, so it is fixed here
+  message_total = msg->message_length;
+  message_left = message_total - msg->message_initial_chunk.size;
+  message_show_digest = message_left > 0;
+  ethereum_message_hash_init(&message_ctx, message_total);
+  sha3_Update(&message_ctx, msg->message_initial_chunk.bytes,
+              msg->message_initial_chunk.size);
+
+  if (message_left > 0) {
+    send_message_request_chunk();
+  } else {
+    send_message_signature();
+  }
+}
+
+void ethereum_message_signing_ack(const EthereumSignMessageAck *msg) {
+  if (!ethereum_message_signing) {
+    fsm_sendFailure(FailureType_Failure_UnexpectedMessage,
+                    _("Not in Ethereum signing mode"));
+    layoutHome();
+    return;
+  }
+
+  if (msg->data_chunk.size > message_left) {
+    fsm_sendFailure(FailureType_Failure_DataError, _("Too much data"));
+    ethereum_message_signing_abort();
+    return;
+  }
+
+  if (!msg->has_data_chunk || msg->data_chunk.size == 0) {
+    fsm_sendFailure(FailureType_Failure_DataError,
+                    _("Empty data chunk received"));
+    ethereum_message_signing_abort();
+    return;
+  }
+
+  sha3_Update(&message_ctx, msg->data_chunk.bytes, msg->data_chunk.size);
+  message_left -= msg->data_chunk.size;
+
+  if (message_left > 0) {
+    send_message_request_chunk();
+  } else {
+    send_message_signature();
+  }
+}
+
+void ethereum_message_signing_abort(void) {
+  if (ethereum_message_signing) {
+    memzero(message_privkey, sizeof(message_privkey));
+    memzero(&message_ctx, sizeof(message_ctx));
+    layoutHome();
+    ethereum_message_signing = false;
+  }
+}
+
 int ethereum_message_verify(const EthereumVerifyMessage *msg) {
   if (msg->signature.size != 65) {
     fsm_sendFailure(FailureType_Failure_DataError, _("Malformed signature"));
@@ -23,7 +23,9 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "bip32.h"
+#include "messages-bitkey.pb.h"
 #include "messages-ethereum.pb.h"
+#include "sha3.h"
 
 void ethereum_signing_init(EthereumSignTx *msg, const HDNode *node);
 void ethereum_signing_abort(void);
@@ -31,6 +33,12 @@ void ethereum_signing_txack(const EthereumTxAck *msg);
 
 void ethereum_message_sign(const EthereumSignMessage *msg, const HDNode *node,
                            EthereumMessageSignature *resp);
+void ethereum_message_signing_init(const EthereumSignMessageStream *msg,
+                                   const HDNode *node);
+void ethereum_message_signing_abort(void);
+void ethereum_message_signing_ack(const EthereumSignMessageAck *msg);
+// hashes the prefix of a signed message with message_len bytes
+void ethereum_message_hash_init(struct SHA3_CTX *ctx, uint32_t message_len);
 int ethereum_message_verify(const EthereumVerifyMessage *msg);
 bool ethereum_parse(const char *address, uint8_t pubkeyhash[20]);
 
@@ -0,0 +1,34 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ethereum.h"
+
+void ethereum_message_hash_init(struct SHA3_CTX *ctx, uint32_t message_len) {
+  sha3_256_Init(ctx);
+  sha3_Update(ctx, (const uint8_t *)"\x19" "Ethereum Signed Message:\n", 26);
+
+  // decimal length without leading zeros
+  uint8_t digits[10];
+  size_t pos = sizeof(digits);
+  do {
+    digits[--pos] = '0' + message_len % 10;
+    message_len /= 10;
+  } while (message_len > 0);
+  sha3_Update(ctx, digits + pos, sizeof(digits) - pos);
+}
@@ -0,0 +1,70 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host test of the Ethereum signed message prefix, build and run with
+ * "make EMULATOR=1 test" in the firmware directory.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ethereum.h"
+
+static const struct {
+  uint32_t len;
+  const char *prefix;
+} cases[] = {
+    {0, "0"},
+    {9, "9"},
+    {10, "10"},
+    {99, "99"},
+    {100, "100"},
+    {1024, "1024"},
+    {9999, "9999"},
+    {10000, "10000"},
+    {1000000000, "1000000000"},
+    {4294967295, "4294967295"},
+};
+
+int main(void) {
+  int failures = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    uint8_t hash[32], expected[32];
+    struct SHA3_CTX ctx;
+
+    ethereum_message_hash_init(&ctx, cases[i].len);
+    keccak_Final(&ctx, hash);
+
+    sha3_256_Init(&ctx);
+    sha3_Update(&ctx, (const uint8_t *)"\x19" "Ethereum Signed Message:\n", 26);
+    sha3_Update(&ctx, (const uint8_t *)cases[i].prefix,
+                strlen(cases[i].prefix));
+    keccak_Final(&ctx, expected);
+
+    if (memcmp(hash, expected, sizeof(hash)) != 0) {
+      printf("FAIL: message length %s\n", cases[i].prefix);
+      failures++;
+    }
+  }
+  if (failures == 0) {
+    printf("ethereum_test: all passed\n");
+  }
+  return failures ? 1 : 0;
+}
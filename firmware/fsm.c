@@ -29,42 +29,49 @@
 #include "crypto.h"
 #include "curves.h"
 #include "debug.h"
+#include "debug_screen.h"
 #include "ecdsa.h"
-#include "ethereum.h"
 #include "fsm.h"
 #include "gettext.h"
 #include "hmac.h"
 #include "layout2.h"
-#include "lisk.h"
 #include "memory.h"
 #include "memzero.h"
+#include "message_signing.h"
 #include "messages.h"
 #include "messages.pb.h"
-#include "nem.h"
-#include "nem2.h"
 #include "oled.h"
+#include "pb_encode.h"
 #include "pinmatrix.h"
+#include "profile.h"
 #include "protect.h"
+#include "ram.h"
 #include "recovery.h"
 #include "reset.h"
 #include "rfc6979.h"
 #include "rng.h"
+#include "scratch.h"
 #include "secp256k1.h"
 #include "signing.h"
-#include "stellar.h"
 #include "supervise.h"
 #include "transaction.h"
 #include "trezor.h"
 #include "usb.h"
 #include "util.h"
+#if !BITCOIN_ONLY
+#include "ethereum.h"
+#include "lisk.h"
+#include "nem.h"
+#include "nem2.h"
+#include "stellar.h"
+#endif
 
 // message methods
 
-static uint8_t msg_resp[MSG_OUT_SIZE] __attribute__((aligned));
-
-#define RESP_INIT(TYPE)                                                    \
-  TYPE *resp = (TYPE *)(void *)msg_resp;                                   \
-  _Static_assert(sizeof(msg_resp) >= sizeof(TYPE), #TYPE " is too large"); \
+#define RESP_INIT(TYPE)                                 \
+  TYPE *resp = (TYPE *)scratch_response();              \
+  _Static_assert(SCRATCH_RESPONSE_SIZE >= sizeof(TYPE), \
+                 #TYPE " is too large");                \
   memzero(resp, sizeof(TYPE));
 
 #define CHECK_INITIALIZED                                      \
@@ -216,8 +223,11 @@ static HDNode *fsm_getDerivedNode(const char *curve, const uint32_t *address_n,
   if (!address_n || address_n_count == 0) {
     return &node;
   }
-  if (hdnode_private_ckd_cached(&node, address_n, address_n_count,
-                                fingerprint) == 0) {
+  PROFILE_START(PROFILE_HDNODE_CKD);
+  int derived = hdnode_private_ckd_cached(&node, address_n, address_n_count,
+                                          fingerprint);
+  PROFILE_END(PROFILE_HDNODE_CKD);
+  if (derived == 0) {
     fsm_sendFailure(FailureType_Failure_ProcessError,
                     _("Failed to derive private key"));
     layoutHome();
@@ -254,7 +264,9 @@ static bool fsm_layoutAddress(const char *address, const char *desc,
 #include "fsm_msg_common.h"
 #include "fsm_msg_crypto.h"
 #include "fsm_msg_debug.h"
+#if !BITCOIN_ONLY
 #include "fsm_msg_ethereum.h"
 #include "fsm_msg_lisk.h"
 #include "fsm_msg_nem.h"
 #include "fsm_msg_stellar.h"
+#endif
@@ -21,6 +21,7 @@
 #define __FSM_H__
 
 #include "messages-bitcoin.pb.h"
+#include "messages-bitkey.pb.h"
 #include "messages-crypto.pb.h"
 #include "messages-debug.pb.h"
 #include "messages-ethereum.pb.h"
@@ -51,6 +52,9 @@ void fsm_sendFailure(FailureType code, const char *text);
 void fsm_msgInitialize(const Initialize *msg);
 void fsm_msgGetFeatures(const GetFeatures *msg);
 void fsm_msgPing(const Ping *msg);
+// answered from tasks while another handler waits, see task.h
+void fsm_taskGetFeatures(void);
+void fsm_taskPing(const Ping *msg);
 void fsm_msgChangePin(const ChangePin *msg);
 void fsm_msgWipeDevice(const WipeDevice *msg);
 void fsm_msgGetEntropy(const GetEntropy *msg);
@@ -73,10 +77,14 @@ void fsm_msgTxAck(
     TxAck *msg);  // not const because we mutate input/output scripts
 void fsm_msgGetAddress(const GetAddress *msg);
 void fsm_msgSignMessage(const SignMessage *msg);
+void fsm_msgSignMessageStream(const SignMessageStream *msg);
+void fsm_msgSignMessageAck(const SignMessageAck *msg);
 void fsm_msgVerifyMessage(const VerifyMessage *msg);
+void fsm_msgVerifyMessages(const VerifyMessages *msg);
 
 // crypto
 void fsm_msgCipherKeyValue(const CipherKeyValue *msg);
+void fsm_msgCipherKeyValues(const CipherKeyValues *msg);
 void fsm_msgSignIdentity(const SignIdentity *msg);
 void fsm_msgGetECDHSessionKey(const GetECDHSessionKey *msg);
 void fsm_msgCosiCommit(const CosiCommit *msg);
@@ -90,8 +98,16 @@ void fsm_msgDebugLinkStop(const DebugLinkStop *msg);
 void fsm_msgDebugLinkMemoryWrite(const DebugLinkMemoryWrite *msg);
 void fsm_msgDebugLinkMemoryRead(const DebugLinkMemoryRead *msg);
 void fsm_msgDebugLinkFlashErase(const DebugLinkFlashErase *msg);
+void fsm_msgDebugLinkFlashSnapshot(const DebugLinkFlashSnapshot *msg);
+void fsm_msgDebugLinkFlashRestore(const DebugLinkFlashRestore *msg);
+void fsm_msgDebugLinkAdvanceTime(const DebugLinkAdvanceTime *msg);
+void fsm_msgDebugLinkGetProfile(const DebugLinkGetProfile *msg);
+void fsm_msgDebugLinkGetMemoryUsage(const DebugLinkGetMemoryUsage *msg);
+void fsm_msgDebugLinkWatchScreen(const DebugLinkWatchScreen *msg);
 #endif
 
+#if !BITCOIN_ONLY
+
 // ethereum
 void fsm_msgEthereumGetAddress(const EthereumGetAddress *msg);
 void fsm_msgEthereumGetPublicKey(const EthereumGetPublicKey *msg);
@@ -100,6 +116,8 @@ void fsm_msgEthereumSignTx(
         *msg);  // not const because we mutate transaction during validation
 void fsm_msgEthereumTxAck(const EthereumTxAck *msg);
 void fsm_msgEthereumSignMessage(const EthereumSignMessage *msg);
+void fsm_msgEthereumSignMessageStream(const EthereumSignMessageStream *msg);
+void fsm_msgEthereumSignMessageAck(const EthereumSignMessageAck *msg);
 void fsm_msgEthereumVerifyMessage(const EthereumVerifyMessage *msg);
 
 // lisk
@@ -122,6 +140,7 @@ void fsm_msgNEMDecryptMessage(
 void fsm_msgStellarGetAddress(const StellarGetAddress *msg);
 void fsm_msgStellarSignTx(const StellarSignTx *msg);
 void fsm_msgStellarPaymentOp(const StellarPaymentOp *msg);
+void fsm_msgStellarPaymentOps(const StellarPaymentOps *msg);
 void fsm_msgStellarCreateAccountOp(const StellarCreateAccountOp *msg);
 void fsm_msgStellarPathPaymentOp(const StellarPathPaymentOp *msg);
 void fsm_msgStellarManageOfferOp(const StellarManageOfferOp *msg);
@@ -134,3 +153,5 @@ void fsm_msgStellarManageDataOp(const StellarManageDataOp *msg);
 void fsm_msgStellarBumpSequenceOp(const StellarBumpSequenceOp *msg);
 
 #endif
+
+#endif
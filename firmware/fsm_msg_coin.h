@@ -299,6 +299,37 @@ void fsm_msgSignMessage(const SignMessage *msg) {
   layoutHome();
 }
 
+void fsm_msgSignMessageStream(const SignMessageStream *msg) {
+  CHECK_INITIALIZED
+
+  CHECK_PARAM(msg->message_initial_chunk.size <= msg->message_length,
+              _("Invalid message length"));
+  CHECK_PARAM(msg->message_length == 0 || msg->message_initial_chunk.size > 0,
+              _("Message length provided, but no initial chunk"));
+
+  layoutSignMessage(msg->message_initial_chunk.bytes,
+                    msg->message_initial_chunk.size);
+  if (!protectButton(ButtonRequestType_ButtonRequest_ProtectCall, false)) {
+    fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+    layoutHome();
+    return;
+  }
+
+  CHECK_PIN
+
+  const CoinInfo *coin = fsm_getCoin(msg->has_coin_name, msg->coin_name);
+  if (!coin) return;
+  const HDNode *node = fsm_getDerivedNode(coin->curve_name, msg->address_n,
+                                          msg->address_n_count, NULL);
+  if (!node) return;
+
+  message_signing_init(msg, coin, node);
+}
+
+void fsm_msgSignMessageAck(const SignMessageAck *msg) {
+  message_signing_ack(msg);
+}
+
 void fsm_msgVerifyMessage(const VerifyMessage *msg) {
   CHECK_PARAM(msg->has_address, _("No address provided"));
   CHECK_PARAM(msg->has_message, _("No message provided"));
@@ -327,3 +358,92 @@ void fsm_msgVerifyMessage(const VerifyMessage *msg) {
   }
   layoutHome();
 }
+
+void fsm_msgVerifyMessages(const VerifyMessages *msg) {
+  CHECK_PARAM(msg->entries_count > 0, _("No entries provided"));
+
+  RESP_INIT(VerifiedMessages);
+
+  const CoinInfo *coin = fsm_getCoin(msg->has_coin_name, msg->coin_name);
+  if (!coin) return;
+
+  // addresses already matched in this batch, a repeated address only needs
+  // its recovered key compared instead of being decoded and hashed again
+  struct {
+    const char *address;
+    uint8_t kind;
+    uint8_t pubkey[65];
+  } known[8];
+  size_t known_count = 0;
+
+  SHA256_CTX ctx;
+  sha256_Init(&ctx);
+  uint8_t hash[HASHER_DIGEST_LENGTH];
+  const VerifyMessagesEntry *previous = NULL;
+
+  layoutProgressSwipe(_("Verifying"), 0);
+  for (size_t i = 0; i < msg->entries_count; i++) {
+    const VerifyMessagesEntry *entry = &msg->entries[i];
+    // proof of reserves batches sign the same message with every address
+    if (previous == NULL || previous->message.size != entry->message.size ||
+        memcmp(previous->message.bytes, entry->message.bytes,
+               entry->message.size) != 0) {
+      cryptoMessageHash(coin, entry->message.bytes, entry->message.size,
+                        hash);
+    }
+    previous = entry;
+
+    bool verified = false;
+    uint8_t pubkey[65];
+    if (entry->has_address && entry->has_message &&
+        entry->signature.size == 65 &&
+        cryptoMessageRecover(coin, hash, entry->signature.bytes, pubkey) ==
+            0) {
+      uint8_t kind = (entry->signature.bytes[0] - 27) / 4;
+      size_t j = 0;
+      while (j < known_count &&
+             (known[j].kind != kind ||
+              strcmp(known[j].address, entry->address) != 0)) {
+        j++;
+      }
+      if (j < known_count) {
+        verified = memcmp(known[j].pubkey, pubkey, sizeof(pubkey)) == 0;
+      } else if (cryptoMessageCheckAddress(coin, entry->address,
+                                           entry->signature.bytes,
+                                           pubkey) == 0) {
+        verified = true;
+        if (known_count < sizeof(known) / sizeof(known[0])) {
+          known[known_count].address = entry->address;
+          known[known_count].kind = kind;
+          memcpy(known[known_count].pubkey, pubkey, sizeof(pubkey));
+          known_count++;
+        }
+      }
+    }
+
+    uint8_t signature[65] = {0};
+    memcpy(signature, entry->signature.bytes, entry->signature.size);
+    uint8_t address_len = strlen(entry->address);
+    uint8_t result = verified ? 1 : 0;
+    sha256_Update(&ctx, hash, sizeof(hash));
+    sha256_Update(&ctx, signature, sizeof(signature));
+    sha256_Update(&ctx, &address_len, 1);
+    sha256_Update(&ctx, (const uint8_t *)entry->address, address_len);
+    sha256_Update(&ctx, &result, 1);
+
+    if (verified) {
+      resp->results.bytes[i / 8] |= 1 << (i % 8);
+      resp->verified++;
+    }
+    layoutProgress(_("Verifying"), 1000 * (i + 1) / msg->entries_count);
+  }
+
+  resp->has_results = true;
+  resp->results.size = (msg->entries_count + 7) / 8;
+  resp->has_verified = true;
+  resp->has_digest = true;
+  resp->digest.size = SHA256_DIGEST_LENGTH;
+  sha256_Final(&ctx, resp->digest.bytes);
+  msg_write(BitkeyMessageType_MessageType_VerifiedMessages, resp);
+  layoutHome();
+}
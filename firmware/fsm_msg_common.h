@@ -20,6 +20,10 @@
 void fsm_msgInitialize(const Initialize *msg) {
   recovery_abort();
   signing_abort();
+  message_signing_abort();
+#if !BITCOIN_ONLY
+  ethereum_message_signing_abort();
+#endif
   if (msg && msg->has_state && msg->state.size == 64) {
     uint8_t i_state[64];
     if (!session_getState(msg->state.bytes, i_state, NULL)) {
@@ -36,9 +40,7 @@ void fsm_msgInitialize(const Initialize *msg) {
   fsm_msgGetFeatures(0);
 }
 
-void fsm_msgGetFeatures(const GetFeatures *msg) {
-  (void)msg;
-  RESP_INIT(Features);
+static void fsm_fillFeatures(Features *resp) {
   resp->has_vendor = true;
   strlcpy(resp->vendor, "trezor.io", sizeof(resp->vendor));
   resp->has_major_version = true;
@@ -82,10 +84,37 @@ void fsm_msgGetFeatures(const GetFeatures *msg) {
   resp->has_flags = config_getFlags(&(resp->flags));
   resp->has_model = true;
   strlcpy(resp->model, "1", sizeof(resp->model));
+}
 
+void fsm_msgGetFeatures(const GetFeatures *msg) {
+  (void)msg;
+  RESP_INIT(Features);
+  fsm_fillFeatures(resp);
   msg_write(MessageType_MessageType_Features, resp);
 }
 
+// the scratch response belongs to the waiting handler, so tasks build their
+// responses in static buffers. Tasks do not nest, and they run on top of
+// the yielding handler, e.g. deep in PBKDF2 from get_root_node_callback, so
+// they must not take the responses on the stack.
+
+void fsm_taskGetFeatures(void) {
+  static Features resp;
+  memzero(&resp, sizeof(resp));
+  fsm_fillFeatures(&resp);
+  msg_write(MessageType_MessageType_Features, &resp);
+}
+
+void fsm_taskPing(const Ping *msg) {
+  static Success resp;
+  memzero(&resp, sizeof(resp));
+  if (msg->has_message) {
+    resp.has_message = true;
+    memcpy(&(resp.message), &(msg->message), sizeof(resp.message));
+  }
+  msg_write(MessageType_MessageType_Success, &resp);
+}
+
 void fsm_msgPing(const Ping *msg) {
   RESP_INIT(Success);
 
@@ -273,7 +302,11 @@ void fsm_msgCancel(const Cancel *msg) {
   (void)msg;
   recovery_abort();
   signing_abort();
+  message_signing_abort();
+#if !BITCOIN_ONLY
   ethereum_signing_abort();
+  ethereum_message_signing_abort();
+#endif
   fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
 }
 
@@ -17,6 +17,37 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+static void fsm_cipherKeyValue(const HDNode *node, bool encrypt,
+                               bool ask_on_encrypt, bool ask_on_decrypt,
+                               const char *key, const uint8_t *iv,
+                               size_t iv_size, const uint8_t *in,
+                               size_t size, uint8_t *out) {
+  uint8_t data[256 + 4];
+  strlcpy((char *)data, key, sizeof(data));
+  strlcat((char *)data, ask_on_encrypt ? "E1" : "E0", sizeof(data));
+  strlcat((char *)data, ask_on_decrypt ? "D1" : "D0", sizeof(data));
+
+  hmac_sha512(node->private_key, 32, data, strlen((char *)data), data);
+
+  if (iv_size == 16) {
+    // override iv if provided
+    memcpy(data + 32, iv, 16);
+  }
+
+  if (encrypt) {
+    aes_encrypt_ctx ctx;
+    aes_encrypt_key256(data, &ctx);
+    aes_cbc_encrypt(in, out, size, data + 32, &ctx);
+    memzero(&ctx, sizeof(ctx));
+  } else {
+    aes_decrypt_ctx ctx;
+    aes_decrypt_key256(data, &ctx);
+    aes_cbc_decrypt(in, out, size, data + 32, &ctx);
+    memzero(&ctx, sizeof(ctx));
+  }
+  memzero(data, sizeof(data));
+}
+
 void fsm_msgCipherKeyValue(const CipherKeyValue *msg) {
   CHECK_INITIALIZED
 
@@ -43,33 +74,86 @@ void fsm_msgCipherKeyValue(const CipherKeyValue *msg) {
     }
   }
 
-  uint8_t data[256 + 4];
-  strlcpy((char *)data, msg->key, sizeof(data));
-  strlcat((char *)data, ask_on_encrypt ? "E1" : "E0", sizeof(data));
-  strlcat((char *)data, ask_on_decrypt ? "D1" : "D0", sizeof(data));
+  RESP_INIT(CipheredKeyValue);
+  fsm_cipherKeyValue(node, encrypt, ask_on_encrypt, ask_on_decrypt, msg->key,
+                     msg->iv.bytes, msg->iv.size, msg->value.bytes,
+                     msg->value.size, resp->value.bytes);
+  resp->has_value = true;
+  resp->value.size = msg->value.size;
+  msg_write(MessageType_MessageType_CipheredKeyValue, resp);
+  layoutHome();
+}
 
-  hmac_sha512(node->private_key, 32, data, strlen((char *)data), data);
+typedef struct {
+  const CipherKeyValues *msg;
+  const HDNode *node;
+} CipherKeyValuesState;
+
+// computes every value while the response is being encoded, so the results
+// never need a buffer of their own
+static bool fsm_encodeCipheredKeyValues(pb_ostream_t *stream,
+                                        const pb_field_t *field,
+                                        void *const *arg) {
+  const CipherKeyValuesState *state = *arg;
+  const CipherKeyValues *msg = state->msg;
+  bool encrypt = msg->has_encrypt && msg->encrypt;
+  bool ask_on_encrypt = msg->has_ask_on_encrypt && msg->ask_on_encrypt;
+  bool ask_on_decrypt = msg->has_ask_on_decrypt && msg->ask_on_decrypt;
+  uint8_t value[sizeof(msg->entries[0].value.bytes)];
+  bool ok = true;
+  for (pb_size_t i = 0; ok && i < msg->entries_count; i++) {
+    const CipherKeyValuesEntry *entry = &msg->entries[i];
+    fsm_cipherKeyValue(state->node, encrypt, ask_on_encrypt, ask_on_decrypt,
+                       entry->key, entry->iv.bytes, entry->iv.size,
+                       entry->value.bytes, entry->value.size, value);
+    ok = pb_encode_tag_for_field(stream, field) &&
+         pb_encode_string(stream, value, entry->value.size);
+  }
+  memzero(value, sizeof(value));
+  return ok;
+}
 
-  if (msg->iv.size == 16) {
-    // override iv if provided
-    memcpy(data + 32, msg->iv.bytes, 16);
+void fsm_msgCipherKeyValues(const CipherKeyValues *msg) {
+  CHECK_INITIALIZED
+
+  CHECK_PARAM(msg->entries_count > 0, _("No entries provided"));
+  // tag, length and value of every result
+  size_t size = 0;
+  for (pb_size_t i = 0; i < msg->entries_count; i++) {
+    const CipherKeyValuesEntry *entry = &msg->entries[i];
+    CHECK_PARAM(entry->has_key, _("No key provided"));
+    CHECK_PARAM(entry->has_value, _("No value provided"));
+    CHECK_PARAM(entry->value.size % 16 == 0,
+                _("Value length must be a multiple of 16"));
+    size += 1 + (entry->value.size < 128 ? 1 : 2) + entry->value.size;
   }
+  CHECK_PARAM(size <= MSG_OUT_ENCODED_MAX, _("Too many entries"));
 
-  RESP_INIT(CipheredKeyValue);
-  if (encrypt) {
-    aes_encrypt_ctx ctx;
-    aes_encrypt_key256(data, &ctx);
-    aes_cbc_encrypt(msg->value.bytes, resp->value.bytes, msg->value.size,
-                    data + 32, &ctx);
-  } else {
-    aes_decrypt_ctx ctx;
-    aes_decrypt_key256(data, &ctx);
-    aes_cbc_decrypt(msg->value.bytes, resp->value.bytes, msg->value.size,
-                    data + 32, &ctx);
+  CHECK_PIN
+
+  const HDNode *node = fsm_getDerivedNode(SECP256K1_NAME, msg->address_n,
+                                          msg->address_n_count, NULL);
+  if (!node) return;
+
+  bool encrypt = msg->has_encrypt && msg->encrypt;
+  bool ask_on_encrypt = msg->has_ask_on_encrypt && msg->ask_on_encrypt;
+  bool ask_on_decrypt = msg->has_ask_on_decrypt && msg->ask_on_decrypt;
+  if ((encrypt && ask_on_encrypt) || (!encrypt && ask_on_decrypt)) {
+    for (pb_size_t i = 0; i < msg->entries_count; i++) {
+      layoutCipherKeyValue(encrypt, msg->entries[i].key);
+      if (!protectButton(ButtonRequestType_ButtonRequest_Other, false)) {
+        fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+        layoutHome();
+        return;
+      }
+    }
   }
-  resp->has_value = true;
-  resp->value.size = msg->value.size;
-  msg_write(MessageType_MessageType_CipheredKeyValue, resp);
+
+  CipherKeyValuesState state = {msg, node};
+  RESP_INIT(CipheredKeyValues);
+  resp->values.funcs.encode = fsm_encodeCipheredKeyValues;
+  resp->values.arg = &state;
+  msg_write(BitkeyMessageType_MessageType_CipheredKeyValues, resp);
   layoutHome();
 }
 
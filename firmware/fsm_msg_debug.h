@@ -22,44 +22,46 @@
 void fsm_msgDebugLinkGetState(const DebugLinkGetState *msg) {
   (void)msg;
 
-  // Do not use RESP_INIT because it clears msg_resp, but another message
+  // Do not use RESP_INIT because it clears the response, but another message
   // might be being handled
-  DebugLinkState resp;
-  memzero(&resp, sizeof(resp));
+  size_t mark = scratch_mark();
+  DebugLinkState *resp = SCRATCH_ALLOC(DebugLinkState);
+  memzero(resp, sizeof(DebugLinkState));
 
-  resp.has_layout = true;
-  resp.layout.size = OLED_BUFSIZE;
-  memcpy(resp.layout.bytes, oledGetBuffer(), OLED_BUFSIZE);
+  resp->has_layout = true;
+  resp->layout.size = OLED_BUFSIZE;
+  memcpy(resp->layout.bytes, oledGetBuffer(), OLED_BUFSIZE);
 
-  resp.has_pin = config_getPin(resp.pin, sizeof(resp.pin));
+  resp->has_pin = config_getPin(resp->pin, sizeof(resp->pin));
 
-  resp.has_matrix = true;
-  strlcpy(resp.matrix, pinmatrix_get(), sizeof(resp.matrix));
+  resp->has_matrix = true;
+  strlcpy(resp->matrix, pinmatrix_get(), sizeof(resp->matrix));
 
-  resp.has_reset_entropy = true;
-  resp.reset_entropy.size = reset_get_int_entropy(resp.reset_entropy.bytes);
+  resp->has_reset_entropy = true;
+  resp->reset_entropy.size = reset_get_int_entropy(resp->reset_entropy.bytes);
 
-  resp.has_reset_word = true;
-  strlcpy(resp.reset_word, reset_get_word(), sizeof(resp.reset_word));
+  resp->has_reset_word = true;
+  strlcpy(resp->reset_word, reset_get_word(), sizeof(resp->reset_word));
 
-  resp.has_recovery_fake_word = true;
-  strlcpy(resp.recovery_fake_word, recovery_get_fake_word(),
-          sizeof(resp.recovery_fake_word));
+  resp->has_recovery_fake_word = true;
+  strlcpy(resp->recovery_fake_word, recovery_get_fake_word(),
+          sizeof(resp->recovery_fake_word));
 
-  resp.has_recovery_word_pos = true;
-  resp.recovery_word_pos = recovery_get_word_pos();
+  resp->has_recovery_word_pos = true;
+  resp->recovery_word_pos = recovery_get_word_pos();
 
-  resp.has_mnemonic_secret = config_getMnemonicBytes(
-      resp.mnemonic_secret.bytes, sizeof(resp.mnemonic_secret.bytes),
-      &resp.mnemonic_secret.size);
-  resp.mnemonic_type = 0;  // BIP-39
+  resp->has_mnemonic_secret = config_getMnemonicBytes(
+      resp->mnemonic_secret.bytes, sizeof(resp->mnemonic_secret.bytes),
+      &resp->mnemonic_secret.size);
+  resp->mnemonic_type = 0;  // BIP-39
 
-  resp.has_node = config_dumpNode(&(resp.node));
+  resp->has_node = config_dumpNode(&(resp->node));
 
-  resp.has_passphrase_protection =
-      config_getPassphraseProtection(&(resp.passphrase_protection));
+  resp->has_passphrase_protection =
+      config_getPassphraseProtection(&(resp->passphrase_protection));
 
-  msg_debug_write(MessageType_MessageType_DebugLinkState, &resp);
+  msg_debug_write(MessageType_MessageType_DebugLinkState, resp);
+  scratch_release(mark);
 }
 
 void fsm_msgDebugLinkStop(const DebugLinkStop *msg) { (void)msg; }
@@ -100,4 +102,86 @@ void fsm_msgDebugLinkFlashErase(const DebugLinkFlashErase *msg) {
   uint32_t dummy = svc_flash_lock();
   (void)dummy;
 }
+
+void fsm_msgDebugLinkFlashSnapshot(const DebugLinkFlashSnapshot *msg) {
+  (void)msg;
+#if EMULATOR
+  emulatorFlashSnapshot();
+#endif
+}
+
+void fsm_msgDebugLinkFlashRestore(const DebugLinkFlashRestore *msg) {
+  (void)msg;
+#if EMULATOR
+  if (emulatorFlashRestore()) {
+    // storage keeps its state in RAM, reload it from the restored flash
+    session_clear(false);
+    config_init();
+    layoutHome();
+  }
+#endif
+}
+
+void fsm_msgDebugLinkAdvanceTime(const DebugLinkAdvanceTime *msg) {
+#if EMULATOR
+  emulatorAdvanceTime(msg->milliseconds);
+#else
+  (void)msg;
+#endif
+}
+
+void fsm_msgDebugLinkGetProfile(const DebugLinkGetProfile *msg) {
+  RESP_INIT(DebugLinkProfile);
+
+#if PROFILE_ZONES
+  for (int i = 0; i < PROFILE_ZONE_COUNT; i++) {
+    if (resp->zones_count >= sizeof(resp->zones) / sizeof(resp->zones[0])) {
+      break;
+    }
+    const ProfileCounter *counter = profile_counter(i);
+    DebugLinkProfileZone *zone = &resp->zones[resp->zones_count++];
+    zone->has_name = true;
+    strlcpy(zone->name, profile_name(i), sizeof(zone->name));
+    zone->has_calls = true;
+    zone->calls = counter->calls;
+    zone->has_total = true;
+    zone->total = counter->total;
+    zone->has_max = true;
+    zone->max = counter->max;
+  }
+  if (msg->has_reset && msg->reset) {
+    profile_reset();
+  }
+#else
+  (void)msg;
+#endif
+
+  msg_debug_write(BitkeyMessageType_MessageType_DebugLinkProfile, resp);
+}
+
+void fsm_msgDebugLinkGetMemoryUsage(const DebugLinkGetMemoryUsage *msg) {
+  (void)msg;
+  RESP_INIT(DebugLinkMemoryUsage);
+
+  RamUsage usage;
+  ram_usage(&usage);
+  resp->has_stack_size = true;
+  resp->stack_size = usage.stack_size;
+  resp->has_stack_used = true;
+  resp->stack_used = usage.stack_used;
+  resp->has_data_size = true;
+  resp->data_size = usage.data_size;
+  resp->has_bss_size = true;
+  resp->bss_size = usage.bss_size;
+  resp->has_confidential_size = true;
+  resp->confidential_size = usage.confidential_size;
+  resp->has_scratch_peak = true;
+  resp->scratch_peak = scratch_peak();
+
+  msg_debug_write(BitkeyMessageType_MessageType_DebugLinkMemoryUsage, resp);
+}
+
+void fsm_msgDebugLinkWatchScreen(const DebugLinkWatchScreen *msg) {
+  debug_screen_watch(msg->has_watch && msg->watch);
+}
 #endif
@@ -152,6 +152,35 @@ void fsm_msgEthereumSignMessage(const EthereumSignMessage *msg) {
   layoutHome();
 }
 
+void fsm_msgEthereumSignMessageStream(const EthereumSignMessageStream *msg) {
+  CHECK_INITIALIZED
+
+  CHECK_PARAM(msg->message_initial_chunk.size <= msg->message_length,
+              _("Invalid message length"));
+  CHECK_PARAM(msg->message_length == 0 || msg->message_initial_chunk.size > 0,
+              _("Message length provided, but no initial chunk"));
+
+  layoutSignMessage(msg->message_initial_chunk.bytes,
+                    msg->message_initial_chunk.size);
+  if (!protectButton(ButtonRequestType_ButtonRequest_ProtectCall, false)) {
+    fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+    layoutHome();
+    return;
+  }
+
+  CHECK_PIN
+
+  const HDNode *node = fsm_getDerivedNode(SECP256K1_NAME, msg->address_n,
+                                          msg->address_n_count, NULL);
+  if (!node) return;
+
+  ethereum_message_signing_init(msg, node);
+}
+
+void fsm_msgEthereumSignMessageAck(const EthereumSignMessageAck *msg) {
+  ethereum_message_signing_ack(msg);
+}
+
 void fsm_msgEthereumVerifyMessage(const EthereumVerifyMessage *msg) {
   CHECK_PARAM(msg->has_address, _("No address provided"));
   CHECK_PARAM(msg->has_message, _("No message provided"));
@@ -110,6 +110,24 @@ void fsm_msgStellarPaymentOp(const StellarPaymentOp *msg) {
   }
 }
 
+void fsm_msgStellarPaymentOps(const StellarPaymentOps *msg) {
+  if (!stellar_confirmPaymentOps(msg)) return;
+
+  if (stellar_allOperationsConfirmed()) {
+    RESP_INIT(StellarSignedTx);
+
+    stellar_fillSignedTx(resp);
+    msg_write(MessageType_MessageType_StellarSignedTx, resp);
+    layoutHome();
+  }
+  // Request the next operation to sign
+  else {
+    RESP_INIT(StellarTxOpRequest);
+
+    msg_write(MessageType_MessageType_StellarTxOpRequest, resp);
+  }
+}
+
 void fsm_msgStellarPathPaymentOp(const StellarPathPaymentOp *msg) {
   if (!stellar_confirmPathPaymentOp(msg)) return;
 
@@ -27,9 +27,12 @@
 #include "gettext.h"
 #include "layout2.h"
 #include "memzero.h"
+#if !BITCOIN_ONLY
 #include "nem2.h"
+#endif
 #include "oled.h"
 #include "qrcodegen.h"
+#include "scratch.h"
 #include "secp256k1.h"
 #include "string.h"
 #include "timer.h"
@@ -446,6 +449,13 @@ void layoutSignMessage(const uint8_t *msg, uint32_t len) {
   }
 }
 
+void layoutSignMessageDigest(const uint8_t *hash) {
+  const char **str = split_message_hex(hash, 32);
+  layoutDialogSwipe(&bmp_icon_question, _("Cancel"), _("Confirm"),
+                    _("Sign message digest?"), str[0], str[1], str[2], str[3],
+                    NULL, NULL);
+}
+
 void layoutVerifyMessage(const uint8_t *msg, uint32_t len) {
   const char **str;
   if (!is_valid_ascii(msg, len)) {
@@ -567,8 +577,12 @@ void layoutAddress(const char *address, const char *desc, bool qrcode,
                                 : address[i];
       }
     }
-    uint8_t codedata[qrcodegen_BUFFER_LEN_FOR_VERSION(QR_MAX_VERSION)];
-    uint8_t tempdata[qrcodegen_BUFFER_LEN_FOR_VERSION(QR_MAX_VERSION)];
+    size_t mark = scratch_mark();
+    SCRATCH_SITE(2 * qrcodegen_BUFFER_LEN_FOR_VERSION(QR_MAX_VERSION));
+    uint8_t *codedata =
+        scratch_alloc(qrcodegen_BUFFER_LEN_FOR_VERSION(QR_MAX_VERSION));
+    uint8_t *tempdata =
+        scratch_alloc(qrcodegen_BUFFER_LEN_FOR_VERSION(QR_MAX_VERSION));
 
     int side = 0;
     if (qrcodegen_encodeText(ignorecase ? address_upcase : address, tempdata,
@@ -598,6 +612,7 @@ void layoutAddress(const char *address, const char *desc, bool qrcode,
         }
       }
     }
+    scratch_release(mark);
   } else {
     if (desc) {
       oledDrawString(0, 0 * 9, desc, FONT_STANDARD);
@@ -750,6 +765,8 @@ void layoutU2FDialog(const char *verb, const char *appname) {
                NULL, appname, NULL, NULL);
 }
 
+#if !BITCOIN_ONLY
+
 void layoutNEMDialog(const BITMAP *icon, const char *btnNo, const char *btnYes,
                      const char *desc, const char *line1, const char *address) {
   static char first_third[NEM_ADDRESS_SIZE / 3 + 1];
@@ -908,6 +925,8 @@ void layoutNEMLevy(const NEMMosaicDefinition *definition, uint8_t network) {
   }
 }
 
+#endif
+
 static inline bool is_slip18(const uint32_t *address_n,
                              size_t address_n_count) {
   return address_n_count == 2 && address_n[0] == (0x80000000 + 10018) &&
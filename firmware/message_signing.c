@@ -0,0 +1,150 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "message_signing.h"
+#include <string.h>
+#include "crypto.h"
+#include "fsm.h"
+#include "gettext.h"
+#include "layout2.h"
+#include "memzero.h"
+#include "messages.h"
+#include "messages.pb.h"
+#include "protect.h"
+#include "transaction.h"
+
+static bool message_signing = false;
+static uint32_t data_total, data_left;
+// the preview showed only part of the message
+static bool show_digest;
+static const CoinInfo *coin;
+static InputScriptType script_type;
+static CONFIDENTIAL HDNode node;
+static Hasher hasher;
+
+static void send_request_chunk(void) {
+  int progress = 1000 - (data_total > 1000000 ? data_left / (data_total / 800)
+                                              : data_left * 800 / data_total);
+  layoutProgress(_("Signing"), progress);
+  SignMessageRequest request;
+  memzero(&request, sizeof(request));
+  request.has_data_length = true;
+  request.data_length = data_left <= 1024 ? data_left : 1024;
+  msg_write(BitkeyMessageType_MessageType_SignMessageRequest, &request);
+}
+
+static void send_signature(void) {
+  uint8_t hash[HASHER_DIGEST_LENGTH];
+  hasher_Final(&hasher, hash);
+
+  if (show_digest) {
+    layoutSignMessageDigest(hash);
+    if (!protectButton(ButtonRequestType_ButtonRequest_ProtectCall, false)) {
+      fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+      message_signing_abort();
+      return;
+    }
+  }
+
+  layoutProgress(_("Signing"), 1000);
+  MessageSignature resp;
+  memzero(&resp, sizeof(resp));
+  if (cryptoMessageSignDigest(&node, script_type, hash,
+                              resp.signature.bytes) != 0) {
+    fsm_sendFailure(FailureType_Failure_ProcessError,
+                    _("Error signing message"));
+    message_signing_abort();
+    return;
+  }
+  hdnode_fill_public_key(&node);
+  if (!compute_address(coin, script_type, &node, false, NULL, resp.address)) {
+    fsm_sendFailure(FailureType_Failure_ProcessError,
+                    _("Error computing address"));
+    message_signing_abort();
+    return;
+  }
+  resp.has_address = true;
+  resp.has_signature = true;
+  resp.signature.size = 65;
+  msg_write(MessageType_MessageType_MessageSignature, &resp);
+
+  message_signing_abort();
+}
+
+void message_signing_init(const SignMessageStream *msg, const CoinInfo *_coin,
+                          const HDNode *_node) {
+  message_signing = true;
+  coin = _coin;
+  script_type = msg->script_type;
+  memcpy(&node, _node, sizeof(HDNode));
+
+  // the length goes into the hash before the message, so it is fixed here
+  data_total = msg->message_length;
+  data_left = data_total - msg->message_initial_chunk.size;
+  show_digest = data_left > 0;
+  cryptoMessageHashInit(coin, data_total, &hasher);
+  hasher_Update(&hasher, msg->message_initial_chunk.bytes,
+                msg->message_initial_chunk.size);
+
+  if (data_left > 0) {
+    send_request_chunk();
+  } else {
+    send_signature();
+  }
+}
+
+void message_signing_ack(const SignMessageAck *msg) {
+  if (!message_signing) {
+    fsm_sendFailure(FailureType_Failure_UnexpectedMessage,
+                    _("Not in Signing mode"));
+    layoutHome();
+    return;
+  }
+
+  if (msg->data_chunk.size > data_left) {
+    fsm_sendFailure(FailureType_Failure_DataError, _("Too much data"));
+    message_signing_abort();
+    return;
+  }
+
+  if (!msg->has_data_chunk || msg->data_chunk.size == 0) {
+    fsm_sendFailure(FailureType_Failure_DataError,
+                    _("Empty data chunk received"));
+    message_signing_abort();
+    return;
+  }
+
+  hasher_Update(&hasher, msg->data_chunk.bytes, msg->data_chunk.size);
+  data_left -= msg->data_chunk.size;
+
+  if (data_left > 0) {
+    send_request_chunk();
+  } else {
+    send_signature();
+  }
+}
+
+void message_signing_abort(void) {
+  if (message_signing) {
+    memzero(&node, sizeof(node));
+    memzero(&hasher, sizeof(hasher));
+    layoutHome();
+    message_signing = false;
+  }
+}
@@ -24,6 +24,9 @@
 #include "gettext.h"
 #include "memzero.h"
 #include "messages.h"
+#include "profile.h"
+#include "scratch.h"
+#include "task.h"
 #include "trezor.h"
 #include "util.h"
 
@@ -68,143 +71,110 @@ void MessageProcessFunc(char type, char dir, uint16_t msg_id, void *ptr) {
   }
 }
 
-static uint32_t msg_out_start = 0;
-static uint32_t msg_out_end = 0;
-static uint32_t msg_out_cur = 0;
-static uint8_t msg_out[MSG_OUT_SIZE];
-
-#if DEBUG_LINK
-
-static uint32_t msg_debug_out_start = 0;
-static uint32_t msg_debug_out_end = 0;
-static uint32_t msg_debug_out_cur = 0;
-static uint8_t msg_debug_out[MSG_DEBUG_OUT_SIZE];
+// outgoing messages are queued as 64 byte reports: a '?' marker followed by
+// 63 bytes of payload
+#define REPORT_SIZE 64
+#define REPORT_PAYLOAD (REPORT_SIZE - 1)
+#define MSG_HEADER_SIZE 8
 
-#endif
+typedef struct {
+  uint8_t *buf;
+  uint32_t reports;
+  uint32_t start;  // next report to send
+  uint32_t end;    // report being filled
+  uint32_t cur;    // bytes used in the report being filled
+} MsgQueue;
 
-static inline void msg_out_append(uint8_t c) {
-  if (msg_out_cur == 0) {
-    msg_out[msg_out_end * 64] = '?';
-    msg_out_cur = 1;
-  }
-  msg_out[msg_out_end * 64 + msg_out_cur] = c;
-  msg_out_cur++;
-  if (msg_out_cur == 64) {
-    msg_out_cur = 0;
-    msg_out_end = (msg_out_end + 1) % (MSG_OUT_SIZE / 64);
-  }
-}
+static uint8_t msg_out[MSG_OUT_SIZE];
+static MsgQueue msg_out_queue = {msg_out, MSG_OUT_SIZE / REPORT_SIZE, 0, 0, 0};
 
 #if DEBUG_LINK
 
-static inline void msg_debug_out_append(uint8_t c) {
-  if (msg_debug_out_cur == 0) {
-    msg_debug_out[msg_debug_out_end * 64] = '?';
-    msg_debug_out_cur = 1;
-  }
-  msg_debug_out[msg_debug_out_end * 64 + msg_debug_out_cur] = c;
-  msg_debug_out_cur++;
-  if (msg_debug_out_cur == 64) {
-    msg_debug_out_cur = 0;
-    msg_debug_out_end = (msg_debug_out_end + 1) % (MSG_DEBUG_OUT_SIZE / 64);
-  }
-}
+static uint8_t msg_debug_out[MSG_DEBUG_OUT_SIZE];
+static MsgQueue msg_debug_out_queue = {
+    msg_debug_out, MSG_DEBUG_OUT_SIZE / REPORT_SIZE, 0, 0, 0};
 
 #endif
 
-static inline void msg_out_pad(void) {
-  if (msg_out_cur == 0) return;
-  while (msg_out_cur < 64) {
-    msg_out[msg_out_end * 64 + msg_out_cur] = 0;
-    msg_out_cur++;
+static void msg_queue_append(MsgQueue *q, const uint8_t *buf, size_t count) {
+  while (count > 0) {
+    uint8_t *report = q->buf + q->end * REPORT_SIZE;
+    if (q->cur == 0) {
+      report[0] = '?';
+      q->cur = 1;
+    }
+    size_t n = MIN(count, REPORT_SIZE - q->cur);
+    memcpy(report + q->cur, buf, n);
+    q->cur += n;
+    buf += n;
+    count -= n;
+    if (q->cur == REPORT_SIZE) {
+      q->cur = 0;
+      q->end = (q->end + 1) % q->reports;
+    }
   }
-  msg_out_cur = 0;
-  msg_out_end = (msg_out_end + 1) % (MSG_OUT_SIZE / 64);
 }
 
-#if DEBUG_LINK
-
-static inline void msg_debug_out_pad(void) {
-  if (msg_debug_out_cur == 0) return;
-  while (msg_debug_out_cur < 64) {
-    msg_debug_out[msg_debug_out_end * 64 + msg_debug_out_cur] = 0;
-    msg_debug_out_cur++;
-  }
-  msg_debug_out_cur = 0;
-  msg_debug_out_end = (msg_debug_out_end + 1) % (MSG_DEBUG_OUT_SIZE / 64);
+static void msg_queue_pad(MsgQueue *q) {
+  if (q->cur == 0) return;
+  memzero(q->buf + q->end * REPORT_SIZE + q->cur, REPORT_SIZE - q->cur);
+  q->cur = 0;
+  q->end = (q->end + 1) % q->reports;
 }
 
-#endif
-
 static bool pb_callback_out(pb_ostream_t *stream, const uint8_t *buf,
                             size_t count) {
-  (void)stream;
-  for (size_t i = 0; i < count; i++) {
-    msg_out_append(buf[i]);
-  }
-  return true;
-}
-
-#if DEBUG_LINK
-
-static bool pb_debug_callback_out(pb_ostream_t *stream, const uint8_t *buf,
-                                  size_t count) {
-  (void)stream;
-  for (size_t i = 0; i < count; i++) {
-    msg_debug_out_append(buf[i]);
-  }
+  msg_queue_append(stream->state, buf, count);
   return true;
 }
 
-#endif
-
 bool msg_write_common(char type, uint16_t msg_id, const void *msg_ptr) {
   const pb_field_t *fields = MessageFields(type, 'o', msg_id);
   if (!fields) {  // unknown message
     return false;
   }
 
-  size_t len;
-  if (!pb_get_encoded_size(&len, fields, msg_ptr)) {
-    return false;
-  }
-
-  void (*append)(uint8_t);
-  bool (*pb_callback)(pb_ostream_t *, const uint8_t *, size_t);
-
+  MsgQueue *q;
   if (type == 'n') {
-    append = msg_out_append;
-    pb_callback = pb_callback_out;
+    q = &msg_out_queue;
   } else
 #if DEBUG_LINK
       if (type == 'd') {
-    append = msg_debug_out_append;
-    pb_callback = pb_debug_callback_out;
+    q = &msg_debug_out_queue;
   } else
 #endif
   {
     return false;
   }
 
-  append('#');
-  append('#');
-  append((msg_id >> 8) & 0xFF);
-  append(msg_id & 0xFF);
-  append((len >> 24) & 0xFF);
-  append((len >> 16) & 0xFF);
-  append((len >> 8) & 0xFF);
-  append(len & 0xFF);
-  pb_ostream_t stream = {pb_callback, 0, SIZE_MAX, 0, 0};
+  // every message starts a new report, the length is patched in once the
+  // message has been encoded
+  uint32_t header = q->end;
+  uint8_t prefix[MSG_HEADER_SIZE] = {'#', '#', (msg_id >> 8) & 0xFF,
+                                     msg_id & 0xFF};
+  msg_queue_append(q, prefix, sizeof(prefix));
+
+  // one report is left unused, a full queue would look empty
+  pb_ostream_t stream = {pb_callback_out, q,
+                         (q->reports - 1) * REPORT_PAYLOAD - MSG_HEADER_SIZE,
+                         0, 0};
+  PROFILE_START(PROFILE_PB_ENCODE);
   bool status = pb_encode(&stream, fields, msg_ptr);
-  if (type == 'n') {
-    msg_out_pad();
-  }
-#if DEBUG_LINK
-  else if (type == 'd') {
-    msg_debug_out_pad();
+  PROFILE_END(PROFILE_PB_ENCODE);
+  if (!status) {
+    // drop the partial message
+    q->end = header;
+    q->cur = 0;
+    return false;
   }
-#endif
-  return status;
+
+  uint8_t *len = q->buf + header * REPORT_SIZE + 1 + 4;
+  len[0] = (stream.bytes_written >> 24) & 0xFF;
+  len[1] = (stream.bytes_written >> 16) & 0xFF;
+  len[2] = (stream.bytes_written >> 8) & 0xFF;
+  len[3] = stream.bytes_written & 0xFF;
+  msg_queue_pad(q);
+  return true;
 }
 
 enum {
@@ -214,20 +184,30 @@ enum {
 
 void msg_process(char type, uint16_t msg_id, const pb_field_t *fields,
                  uint8_t *msg_raw, uint32_t msg_size) {
+  // the decoded message is live for the whole handler and is decoded while
+  // the raw message still takes the arena, so it cannot share it
   static uint8_t msg_data[MSG_IN_SIZE];
+  PROFILE_START(PROFILE_MSG_PROCESS);
   memzero(msg_data, sizeof(msg_data));
   pb_istream_t stream = pb_istream_from_buffer(msg_raw, msg_size);
+  PROFILE_START(PROFILE_PB_DECODE);
   bool status = pb_decode(&stream, fields, msg_data);
+  PROFILE_END(PROFILE_PB_DECODE);
+  // the raw message is no longer needed, the handler gets the arena
+  scratch_received();
   if (status) {
+    size_t mark = scratch_mark();
     MessageProcessFunc(type, 'i', msg_id, msg_data);
+    scratch_release(mark);
   } else {
     fsm_sendFailure(FailureType_Failure_DataError, stream.errmsg);
   }
+  PROFILE_END(PROFILE_MSG_PROCESS);
 }
 
 void msg_read_common(char type, const uint8_t *buf, uint32_t len) {
   static char read_state = READSTATE_IDLE;
-  static uint8_t msg_in[MSG_IN_SIZE];
+  static uint8_t *msg_in = NULL;
   static uint16_t msg_id = 0xFFFF;
   static uint32_t msg_size = 0;
   static uint32_t msg_pos = 0;
@@ -257,11 +237,13 @@ void msg_read_common(char type, const uint8_t *buf, uint32_t len) {
 
     read_state = READSTATE_READING;
 
+    msg_in = scratch_receive();
     memcpy(msg_in, buf + 9, len - 9);
     msg_pos = len - 9;
   } else if (read_state == READSTATE_READING) {
     if (buf[0] != '?') {  // invalid contents
       read_state = READSTATE_IDLE;
+      scratch_received();
       return;
     }
     /* raw data starts at buf + 1 with len - 1 bytes */
@@ -279,24 +261,35 @@ void msg_read_common(char type, const uint8_t *buf, uint32_t len) {
   }
 }
 
+static const uint8_t *msg_queue_data(MsgQueue *q) {
+  if (q->start == q->end) return 0;
+  uint8_t *data = q->buf + q->start * REPORT_SIZE;
+  q->start = (q->start + 1) % q->reports;
+  return data;
+}
+
 const uint8_t *msg_out_data(void) {
-  if (msg_out_start == msg_out_end) return 0;
-  uint8_t *data = msg_out + (msg_out_start * 64);
-  msg_out_start = (msg_out_start + 1) % (MSG_OUT_SIZE / 64);
-  debugLog(0, "", "msg_out_data");
+  const uint8_t *data = msg_queue_data(&msg_out_queue);
+  if (data) {
+    debugLog(0, "", "msg_out_data");
+  }
   return data;
 }
 
 #if DEBUG_LINK
 
 const uint8_t *msg_debug_out_data(void) {
-  if (msg_debug_out_start == msg_debug_out_end) return 0;
-  uint8_t *data = msg_debug_out + (msg_debug_out_start * 64);
-  msg_debug_out_start = (msg_debug_out_start + 1) % (MSG_DEBUG_OUT_SIZE / 64);
-  debugLog(0, "", "msg_debug_out_data");
+  const uint8_t *data = msg_queue_data(&msg_debug_out_queue);
+  if (data) {
+    debugLog(0, "", "msg_debug_out_data");
+  }
   return data;
 }
 
+bool msg_debug_out_empty(void) {
+  return msg_debug_out_queue.start == msg_debug_out_queue.end;
+}
+
 #endif
 
 CONFIDENTIAL uint8_t msg_tiny[128];
@@ -310,9 +303,60 @@ _Static_assert(sizeof(msg_tiny) >= sizeof(DebugLinkDecision),
                "msg_tiny too tiny");
 _Static_assert(sizeof(msg_tiny) >= sizeof(DebugLinkGetState),
                "msg_tiny too tiny");
+_Static_assert(sizeof(msg_tiny) >= sizeof(DebugLinkAdvanceTime),
+               "msg_tiny too tiny");
+_Static_assert(sizeof(msg_tiny) >= sizeof(DebugLinkWatchScreen),
+               "msg_tiny too tiny");
 #endif
 uint16_t msg_tiny_id = 0xFFFF;
 
+// GetFeatures and Ping without protection do not involve the user, so while
+// a handler waits they are answered by a task instead of being rejected
+static uint16_t msg_background_id = 0xFFFF;
+static uint8_t msg_background[64 - 9];
+static uint32_t msg_background_size = 0;
+
+static void msg_process_background(void) {
+  if (msg_background_id == MessageType_MessageType_GetFeatures) {
+    fsm_taskGetFeatures();
+  } else {
+    static Ping ping;
+    memzero(&ping, sizeof(ping));
+    pb_istream_t stream =
+        pb_istream_from_buffer(msg_background, msg_background_size);
+    if (pb_decode(&stream, Ping_fields, &ping)) {
+      fsm_taskPing(&ping);
+    }
+  }
+  msg_background_id = 0xFFFF;
+}
+
+static bool msg_read_background(uint16_t msg_id, const uint8_t *buf,
+                                uint32_t size) {
+  if (msg_background_id != 0xFFFF || size > sizeof(msg_background)) {
+    return false;
+  }
+  if (msg_id == MessageType_MessageType_Ping) {
+    static Ping ping;
+    memzero(&ping, sizeof(ping));
+    pb_istream_t stream = pb_istream_from_buffer(buf, size);
+    if (!pb_decode(&stream, Ping_fields, &ping) ||
+        (ping.has_button_protection && ping.button_protection) ||
+        (ping.has_pin_protection && ping.pin_protection) ||
+        (ping.has_passphrase_protection && ping.passphrase_protection)) {
+      return false;
+    }
+  }
+  memcpy(msg_background, buf, size);
+  msg_background_size = size;
+  msg_background_id = msg_id;
+  if (!task_post(msg_process_background)) {
+    msg_background_id = 0xFFFF;
+    return false;
+  }
+  return true;
+}
+
 void msg_read_tiny(const uint8_t *buf, int len) {
   if (len != 64) return;
   if (buf[0] != '?' || buf[1] != '#' || buf[2] != '#') {
@@ -325,6 +369,12 @@ void msg_read_tiny(const uint8_t *buf, int len) {
     return;
   }
 
+  if ((msg_id == MessageType_MessageType_GetFeatures ||
+       msg_id == MessageType_MessageType_Ping) &&
+      msg_read_background(msg_id, buf + 9, msg_size)) {
+    return;
+  }
+
   const pb_field_t *fields = 0;
   pb_istream_t stream = pb_istream_from_buffer(buf + 9, msg_size);
 
@@ -351,10 +401,29 @@ void msg_read_tiny(const uint8_t *buf, int len) {
     case MessageType_MessageType_DebugLinkGetState:
       fields = DebugLinkGetState_fields;
       break;
+    case BitkeyMessageType_MessageType_DebugLinkAdvanceTime:
+      fields = DebugLinkAdvanceTime_fields;
+      break;
+    case BitkeyMessageType_MessageType_DebugLinkWatchScreen:
+      fields = DebugLinkWatchScreen_fields;
+      break;
 #endif
   }
   if (fields) {
     bool status = pb_decode(&stream, fields, msg_tiny);
+#if DEBUG_LINK
+    // no decision involved, so handle it without involving the waiting loop
+    if (status &&
+        msg_id == BitkeyMessageType_MessageType_DebugLinkAdvanceTime) {
+      fsm_msgDebugLinkAdvanceTime((DebugLinkAdvanceTime *)msg_tiny);
+      return;
+    }
+    if (status &&
+        msg_id == BitkeyMessageType_MessageType_DebugLinkWatchScreen) {
+      fsm_msgDebugLinkWatchScreen((DebugLinkWatchScreen *)msg_tiny);
+      return;
+    }
+#endif
     if (status) {
       msg_tiny_id = msg_id;
     } else {
@@ -27,6 +27,8 @@
 #define MSG_IN_SIZE (15 * 1024)
 
 #define MSG_OUT_SIZE (3 * 1024)
+// largest encoded message that fits the output queue, see msg_write_common
+#define MSG_OUT_ENCODED_MAX ((MSG_OUT_SIZE / 64 - 1) * 63 - 8)
 
 #define msg_read(buf, len) msg_read_common('n', (buf), (len))
 #define msg_write(id, ptr) msg_write_common('n', (id), (ptr))
@@ -39,6 +41,7 @@ const uint8_t *msg_out_data(void);
 #define msg_debug_read(buf, len) msg_read_common('d', (buf), (len))
 #define msg_debug_write(id, ptr) msg_write_common('d', (id), (ptr))
 const uint8_t *msg_debug_out_data(void);
+bool msg_debug_out_empty(void);
 
 #endif
 
@@ -30,14 +30,28 @@
 #include "messages.pb.h"
 #include "oled.h"
 #include "pinmatrix.h"
+#include "task.h"
+#include "timer.h"
 #include "usb.h"
 #include "util.h"
 
 #define MAX_WRONG_PINS 15
 
+// buttons are sampled at this interval, which also debounces them
+#define BUTTON_SAMPLE_MS 5
+// waits without buttons to sample still look around this often
+#define PROTECT_WAIT_MS 100
+
 bool protectAbortedByCancel = false;
 bool protectAbortedByInitialize = false;
 
+// Sleep until a report arrives or millis pass and run the tasks it posted.
+// At most one report is read, so the caller sees every msg_tiny_id.
+static void protectWait(uint32_t millis) {
+  usbWait(millis);
+  task_run();
+}
+
 bool protectButton(ButtonRequestType type, bool confirm_only) {
   ButtonRequest resp;
   bool result = false;
@@ -51,10 +65,16 @@ bool protectButton(ButtonRequestType type, bool confirm_only) {
   resp.code = type;
   usbTiny(1);
   buttonUpdate();  // Clear button state
+  uint32_t sampled = timer_ms();
   msg_write(MessageType_MessageType_ButtonRequest, &resp);
 
   for (;;) {
-    usbPoll();
+    uint32_t wait = PROTECT_WAIT_MS;
+    if (acked) {
+      uint32_t elapsed = timer_ms() - sampled;
+      wait = elapsed < BUTTON_SAMPLE_MS ? BUTTON_SAMPLE_MS - elapsed : 0;
+    }
+    protectWait(wait);
 
     // check for ButtonAck
     if (msg_tiny_id == MessageType_MessageType_ButtonAck) {
@@ -63,8 +83,8 @@ bool protectButton(ButtonRequestType type, bool confirm_only) {
     }
 
     // button acked - check buttons
-    if (acked) {
-      usbSleep(5);
+    if (acked && timer_ms() - sampled >= BUTTON_SAMPLE_MS) {
+      sampled = timer_ms();
       buttonUpdate();
       if (button.YesUp) {
         result = true;
@@ -120,7 +140,7 @@ const char *requestPin(PinMatrixRequestType type, const char *text) {
   msg_write(MessageType_MessageType_PinMatrixRequest, &resp);
   pinmatrix_start(text);
   for (;;) {
-    usbPoll();
+    protectWait(PROTECT_WAIT_MS);
     if (msg_tiny_id == MessageType_MessageType_PinMatrixAck) {
       msg_tiny_id = 0xFFFF;
       PinMatrixAck *pma = (PinMatrixAck *)msg_tiny;
@@ -294,7 +314,7 @@ bool protectPassphrase(void) {
 
   bool result;
   for (;;) {
-    usbPoll();
+    protectWait(PROTECT_WAIT_MS);
     // TODO: correctly process PassphraseAck with state field set (mismatch =>
     // Failure)
     if (msg_tiny_id == MessageType_MessageType_PassphraseAck) {
@@ -3,6 +3,7 @@ import sys
 
 from collections import defaultdict
 from messages_pb2 import MessageType
+from messages_bitkey_pb2 import BitkeyMessageType
 from messages_pb2 import wire_in, wire_out
 from messages_pb2 import wire_debug_in, wire_debug_out
 from messages_pb2 import wire_bootloader, wire_no_fsm
@@ -55,7 +56,7 @@ def handle_message(fh, fl, skipped, message, extension):
     fh.write(TEMPLATE.format(
         type="'%c'," % interface,
         dir="'%c'," % direction,
-        msg_id="MessageType_%s," % name,
+        msg_id="%s_%s," % (message.type.name, name),
         fields="%s_fields," % short_name,
         process_func=process_func,
     ))
@@ -79,12 +80,13 @@ fl.write("// This file is automatically generated by messages_map.py -- DO NOT E
 
 messages = defaultdict(list)
 
-for message in MessageType.DESCRIPTOR.values:
-    extensions = message.GetOptions().Extensions
+for enum in (MessageType, BitkeyMessageType):
+    for message in enum.DESCRIPTOR.values:
+        extensions = message.GetOptions().Extensions
 
-    for extension in (wire_in, wire_out, wire_debug_in, wire_debug_out):
-        if extensions[extension]:
-            messages[extension].append(message)
+        for extension in (wire_in, wire_out, wire_debug_in, wire_debug_out):
+            if extensions[extension]:
+                messages[extension].append(message)
 
 for extension in (wire_in, wire_out, wire_debug_in, wire_debug_out):
     if extension == wire_debug_in:
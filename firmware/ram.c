@@ -0,0 +1,60 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "ram.h"
+#include "util.h"
+
+#if !EMULATOR
+
+// .confidential comes first in RAM, followed by .data and .bss (see
+// memory_app_*.ld); the stack grows down from _stack towards the end of .bss
+
+#define STACK_PAINT 0x57AC57AC
+
+// leave the frames of the function painting the stack alone
+#define STACK_PAINT_MARGIN 64
+
+void ram_paint_stack(void) {
+  uint32_t sp;
+  __asm__ volatile("mov %0, sp" : "=r"(sp));
+  memset_reg(&_ebss, (void *)((sp - STACK_PAINT_MARGIN) & ~3), STACK_PAINT);
+}
+
+void ram_usage(RamUsage *usage) {
+  const unsigned *p = &_ebss;
+  while (p < &_stack && *p == STACK_PAINT) {
+    p++;
+  }
+
+  usage->stack_size = (uint8_t *)&_stack - (uint8_t *)&_ebss;
+  usage->stack_used = (uint8_t *)&_stack - (uint8_t *)p;
+  usage->data_size = (uint8_t *)&_edata - (uint8_t *)&_data;
+  usage->bss_size = (uint8_t *)&_ebss - (uint8_t *)&_edata;
+  usage->confidential_size = (uint8_t *)&_data - _ram_start;
+}
+
+#else
+
+void ram_paint_stack(void) {}
+
+void ram_usage(RamUsage *usage) { memset(usage, 0, sizeof(*usage)); }
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RAM_H__
+#define __RAM_H__
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t stack_size;
+  uint32_t stack_used;
+  uint32_t data_size;
+  uint32_t bss_size;
+  uint32_t confidential_size;
+} RamUsage;
+
+// fill the unused stack with a pattern so that its depth can be measured
+void ram_paint_stack(void);
+
+// all zero in the emulator
+void ram_usage(RamUsage *usage);
+
+#endif
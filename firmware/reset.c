@@ -20,6 +20,7 @@
 #include "reset.h"
 #include "bip39.h"
 #include "config.h"
+#include "drbg.h"
 #include "fsm.h"
 #include "gettext.h"
 #include "layout2.h"
@@ -63,6 +64,8 @@ void reset_init(bool display_random, uint32_t _strength,
     return;
   }
 
+  // the internal entropy of a new wallet comes from a freshly seeded key
+  drbg_reseed();
   random_buffer(int_entropy, 32);
 
   char ent_str[4][17];
@@ -0,0 +1,90 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "common.h"
+#include "memzero.h"
+#include "scratch.h"
+#include "secbool.h"
+
+#define SCRATCH_ALIGN 8
+
+// freed memory is filled with this in debug builds to expose stale pointers
+#define SCRATCH_POISON 0xA5
+
+_Static_assert(SCRATCH_RESPONSE_SIZE % SCRATCH_ALIGN == 0,
+               "scratch response is misaligned");
+
+static uint8_t scratch[SCRATCH_SIZE] __attribute__((aligned(SCRATCH_ALIGN)));
+
+static bool receiving = false;
+static size_t used = SCRATCH_RESPONSE_SIZE;
+static size_t peak = 0;
+
+static void scratch_wipe(size_t start, size_t end) {
+#if DEBUG_LINK
+  memset(scratch + start, SCRATCH_POISON, end - start);
+#else
+  memzero(scratch + start, end - start);
+#endif
+}
+
+uint8_t *scratch_receive(void) {
+  ensure(sectrue * (used == SCRATCH_RESPONSE_SIZE), "scratch in use");
+  receiving = true;
+  return scratch;
+}
+
+void scratch_received(void) {
+  scratch_wipe(0, SCRATCH_SIZE);
+  receiving = false;
+}
+
+void *scratch_response(void) {
+  ensure(sectrue * !receiving, "scratch in use");
+  if (peak < SCRATCH_RESPONSE_SIZE) {
+    peak = SCRATCH_RESPONSE_SIZE;
+  }
+  return scratch;
+}
+
+void *scratch_alloc(size_t size) {
+  ensure(sectrue * !receiving, "scratch in use");
+  size = (size + SCRATCH_ALIGN - 1) & ~(size_t)(SCRATCH_ALIGN - 1);
+  ensure(sectrue * (size <= SCRATCH_SIZE - used), "scratch exhausted");
+
+  void *ptr = scratch + used;
+  used += size;
+  if (peak < used) {
+    peak = used;
+  }
+  return ptr;
+}
+
+size_t scratch_mark(void) { return used; }
+
+void scratch_release(size_t mark) {
+  if (mark < used) {
+    scratch_wipe(mark, used);
+    used = mark;
+  }
+}
+
+size_t scratch_peak(void) { return peak; }
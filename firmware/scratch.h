@@ -0,0 +1,76 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCRATCH_H__
+#define __SCRATCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "messages.h"
+
+/*
+ * Incoming messages are assembled in the scratch arena. Once a message is
+ * decoded the arena is free until the next one arrives, so message
+ * handlers use it for large temporary buffers: waits for user input in the
+ * middle of a handler only accept tiny messages, which bypass the arena.
+ *
+ * The first SCRATCH_RESPONSE_SIZE bytes hold the response being built by
+ * the handler, the rest is a stack of allocations released by
+ * scratch_release. Released memory is wiped (and poisoned in debug builds).
+ */
+
+#define SCRATCH_SIZE MSG_IN_SIZE
+#define SCRATCH_RESPONSE_SIZE MSG_OUT_SIZE
+
+// take the whole arena to assemble an incoming message into
+uint8_t *scratch_receive(void);
+// the incoming message has been decoded or dropped
+void scratch_received(void);
+
+void *scratch_response(void);
+
+void *scratch_alloc(size_t size);
+size_t scratch_mark(void);
+void scratch_release(size_t mark);
+
+// highest number of bytes used by handlers since boot
+size_t scratch_peak(void);
+
+// With STACK_USAGE=1 every allocation leaves a __scratch_site_<n>_<size>
+// label in the function making it, script/stack_usage.py adds them up along
+// the call graph to give the peak use of every message handler.
+#if STACK_USAGE
+#define SCRATCH_SITE(SIZE) \
+  __asm__ volatile("__scratch_site_%=_%c0:" : : "i"(SIZE))
+#else
+#define SCRATCH_SITE(SIZE) \
+  do {                     \
+  } while (0)
+#endif
+
+#define SCRATCH_ALLOC(TYPE)                                              \
+  ({                                                                     \
+    _Static_assert(sizeof(TYPE) <= SCRATCH_SIZE - SCRATCH_RESPONSE_SIZE, \
+                   #TYPE " does not fit the scratch arena");             \
+    SCRATCH_SITE(sizeof(TYPE));                                          \
+    (TYPE *)scratch_alloc(sizeof(TYPE));                                 \
+  })
+
+#endif
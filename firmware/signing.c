@@ -26,6 +26,7 @@
 #include "memzero.h"
 #include "messages.h"
 #include "messages.pb.h"
+#include "profile.h"
 #include "protect.h"
 #include "secp256k1.h"
 #include "transaction.h"
@@ -87,6 +88,21 @@ static uint32_t tx_weight;
 /* The maximum allowed change address.  This should be large enough for normal
    use and still allow to quickly brute-force the correct bip32 path. */
 #define BIP32_MAX_LAST_ELEMENT 1000000
+/* The number of account nodes kept for the current transaction */
+#define ACCOUNT_CACHE_SIZE 4
+/* The maximum depth of a cached account node */
+#define ACCOUNT_MAX_DEPTH 6
+
+/* Account level nodes (the input path without chain and address) derived
+   during this transaction, so that every further input or change output of
+   the same account needs only BIP32_WALLET_DEPTH derivation steps. */
+static CONFIDENTIAL struct {
+  bool set;
+  size_t depth;
+  uint32_t address_n[ACCOUNT_MAX_DEPTH];
+  HDNode node;
+} account_cache[ACCOUNT_CACHE_SIZE];
+static uint32_t account_cache_next;
 
 /* transaction header size: 4 byte version */
 #define TXSIZE_HEADER 4
@@ -404,6 +420,50 @@ bool check_change_bip32_path(const TxOutputType *toutput) {
           toutput->address_n[count - 1] <= BIP32_MAX_LAST_ELEMENT);
 }
 
+static int derive_account_node(const uint32_t *address_n, size_t depth,
+                               HDNode *out) {
+  for (int i = 0; i < ACCOUNT_CACHE_SIZE; i++) {
+    if (account_cache[i].set && account_cache[i].depth == depth &&
+        0 == memcmp(account_cache[i].address_n, address_n,
+                    depth * sizeof(uint32_t))) {
+      memcpy(out, &account_cache[i].node, sizeof(HDNode));
+      return 1;
+    }
+  }
+  memcpy(out, &root, sizeof(HDNode));
+  for (size_t i = 0; i < depth; i++) {
+    if (hdnode_private_ckd(out, address_n[i]) == 0) {
+      return 0;
+    }
+  }
+  uint32_t slot = account_cache_next;
+  account_cache_next = (account_cache_next + 1) % ACCOUNT_CACHE_SIZE;
+  account_cache[slot].set = true;
+  account_cache[slot].depth = depth;
+  memcpy(account_cache[slot].address_n, address_n, depth * sizeof(uint32_t));
+  memcpy(&account_cache[slot].node, out, sizeof(HDNode));
+  return 1;
+}
+
+static int derive_node(const uint32_t *address_n, size_t address_n_count,
+                       HDNode *out) {
+  if (address_n_count < BIP32_WALLET_DEPTH ||
+      address_n_count - BIP32_WALLET_DEPTH > ACCOUNT_MAX_DEPTH) {
+    memcpy(out, &root, sizeof(HDNode));
+    return hdnode_private_ckd_cached(out, address_n, address_n_count, NULL);
+  }
+  size_t depth = address_n_count - BIP32_WALLET_DEPTH;
+  if (derive_account_node(address_n, depth, out) == 0) {
+    return 0;
+  }
+  for (size_t i = depth; i < address_n_count; i++) {
+    if (hdnode_private_ckd(out, address_n[i]) == 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
 bool compile_input_script_sig(TxInputType *tinput) {
   if (!multisig_fp_mismatch) {
     // check that this is still multisig
@@ -424,9 +484,10 @@ bool compile_input_script_sig(TxInputType *tinput) {
       return false;
     }
   }
-  memcpy(&node, &root, sizeof(HDNode));
-  if (hdnode_private_ckd_cached(&node, tinput->address_n,
-                                tinput->address_n_count, NULL) == 0) {
+  PROFILE_START(PROFILE_HDNODE_CKD);
+  int derived = derive_node(tinput->address_n, tinput->address_n_count, &node);
+  PROFILE_END(PROFILE_HDNODE_CKD);
+  if (derived == 0) {
     // Failed to derive private key
     return false;
   }
@@ -449,6 +510,8 @@ void signing_init(const SignTx *msg, const CoinInfo *_coin,
   outputs_count = msg->outputs_count;
   coin = _coin;
   memcpy(&root, _root, sizeof(HDNode));
+  memzero(account_cache, sizeof(account_cache));
+  account_cache_next = 0;
   version = msg->version;
   lock_time = msg->lock_time;
   expiry = msg->expiry;
@@ -656,7 +719,8 @@ static bool signing_check_output(TxOutputType *txoutput) {
     return false;
   }
   spending += txoutput->amount;
-  int co = compile_output(coin, &root, txoutput, &bin_output, !is_change);
+  int co =
+      compile_output(coin, derive_node, txoutput, &bin_output, !is_change);
   if (!is_change) {
     layoutProgress(_("Signing transaction"), progress);
   }
@@ -858,8 +922,11 @@ static bool signing_sign_hash(TxInputType *txinput, const uint8_t *private_key,
   resp.serialized.signature_index = idx1;
   resp.serialized.has_signature = true;
   resp.serialized.has_serialized_tx = true;
-  if (ecdsa_sign_digest(coin->curve->params, private_key, hash, sig, NULL,
-                        NULL) != 0) {
+  PROFILE_START(PROFILE_ECDSA_SIGN);
+  int sign_result = ecdsa_sign_digest(coin->curve->params, private_key, hash,
+                                      sig, NULL, NULL);
+  PROFILE_END(PROFILE_ECDSA_SIGN);
+  if (sign_result != 0) {
     fsm_sendFailure(FailureType_Failure_ProcessError, _("Signing failed"));
     signing_abort();
     return false;
@@ -1288,7 +1355,8 @@ void signing_txack(TransactionType *tx) {
       progress = 500 + ((signatures * progress_step +
                          (inputs_count + idx2) * progress_meta_step) >>
                         PROGRESS_PRECISION);
-      if (compile_output(coin, &root, tx->outputs, &bin_output, false) <= 0) {
+      if (compile_output(coin, derive_node, tx->outputs, &bin_output, false) <=
+          0) {
         fsm_sendFailure(FailureType_Failure_ProcessError,
                         _("Failed to compile output"));
         signing_abort();
@@ -1428,7 +1496,8 @@ void signing_txack(TransactionType *tx) {
       return;
 
     case STAGE_REQUEST_5_OUTPUT:
-      if (compile_output(coin, &root, tx->outputs, &bin_output, false) <= 0) {
+      if (compile_output(coin, derive_node, tx->outputs, &bin_output, false) <=
+          0) {
         fsm_sendFailure(FailureType_Failure_ProcessError,
                         _("Failed to compile output"));
         signing_abort();
@@ -1535,4 +1604,5 @@ void signing_abort(void) {
   }
   memzero(&root, sizeof(root));
   memzero(&node, sizeof(node));
+  memzero(account_cache, sizeof(account_cache));
 }
@@ -297,6 +297,159 @@ bool stellar_confirmPaymentOp(const StellarPaymentOp *msg) {
   return true;
 }
 
+/*
+ * Confirms a batch of payments that share the source account and asset.
+ * A single payment is shown like StellarPaymentOp, several are confirmed
+ * with one summary of their total. The user may then page through every
+ * destination and amount. The payments are hashed one by one in order.
+ */
+bool stellar_confirmPaymentOps(const StellarPaymentOps *msg) {
+  if (!stellar_signing) return false;
+
+  if (msg->payments_count == 0 ||
+      msg->payments_count > stellar_activeTx.num_operations -
+                                stellar_activeTx.confirmed_operations) {
+    stellar_signingAbort(_("Invalid number of operations"));
+    return false;
+  }
+
+  StellarPaymentOp op;
+  memzero(&op, sizeof(op));
+  op.has_source_account = msg->has_source_account;
+  strlcpy(op.source_account, msg->source_account, sizeof(op.source_account));
+  op.has_asset = true;
+  op.asset.has_type = true;
+  op.asset.type = msg->asset_type;
+  op.asset.has_code = msg->has_asset_code;
+  strlcpy(op.asset.code, msg->asset_code, sizeof(op.asset.code));
+  op.asset.has_issuer = msg->has_asset_issuer;
+  strlcpy(op.asset.issuer, msg->asset_issuer, sizeof(op.asset.issuer));
+  op.has_destination_account = true;
+  op.has_amount = true;
+
+  if (msg->payments_count == 1) {
+    strlcpy(op.destination_account, msg->payments[0].destination_account,
+            sizeof(op.destination_account));
+    op.amount = msg->payments[0].amount;
+    return stellar_confirmPaymentOp(&op);
+  }
+
+  // Validate every payment before anything is shown
+  uint8_t bytes[STELLAR_KEY_SIZE];
+  uint64_t total = 0;
+  for (size_t i = 0; i < msg->payments_count; i++) {
+    const StellarPaymentOpsEntry *payment = &msg->payments[i];
+    if (!stellar_getAddressBytes(payment->destination_account, bytes)) {
+      stellar_signingAbort(_("Invalid destination account"));
+      return false;
+    }
+    if (payment->amount <= 0 ||
+        (uint64_t)payment->amount > (uint64_t)INT64_MAX - total) {
+      stellar_signingAbort(_("Invalid amount"));
+      return false;
+    }
+    total += payment->amount;
+  }
+
+  uint8_t source_account_bytes[STELLAR_KEY_SIZE];
+  if (op.has_source_account) {
+    if (!stellar_getAddressBytes(op.source_account, source_account_bytes)) {
+      stellar_signingAbort(_("Source account error"));
+      return false;
+    }
+
+    const char **str_addr_rows =
+        stellar_lineBreakAddress(source_account_bytes);
+    stellar_layoutTransactionDialog(_("Op src account OK?"), NULL,
+                                    str_addr_rows[0], str_addr_rows[1],
+                                    str_addr_rows[2]);
+    if (!protectButton(ButtonRequestType_ButtonRequest_ProtectCall, false)) {
+      stellar_signingAbort(_("User canceled"));
+      return false;
+    }
+  }
+
+  char str_asset_row[32];
+  memzero(str_asset_row, sizeof(str_asset_row));
+  stellar_format_asset(&(op.asset), str_asset_row, sizeof(str_asset_row));
+  if (!stellar_signing) return false;
+
+  char str_pay_amount[32];
+  char str_amount[32];
+  stellar_format_stroops(total, str_amount, sizeof(str_amount));
+  strlcpy(str_pay_amount, _("Pay "), sizeof(str_pay_amount));
+  strlcat(str_pay_amount, str_amount, sizeof(str_pay_amount));
+
+  char str_count[32];
+  char str_number[12];
+  stellar_format_uint32(msg->payments_count, str_number, sizeof(str_number));
+  strlcpy(str_count, _("in "), sizeof(str_count));
+  strlcat(str_count, str_number, sizeof(str_count));
+  strlcat(str_count, _(" payments"), sizeof(str_count));
+
+  stellar_layoutTransactionDialog(str_pay_amount, str_asset_row, str_count,
+                                  NULL, NULL);
+  if (!protectButton(ButtonRequestType_ButtonRequest_ProtectCall, false)) {
+    stellar_signingAbort(_("User canceled"));
+    return false;
+  }
+
+  // The summary does not show where the funds go, so every destination and
+  // amount has to be confirmed on its own
+  for (size_t i = 0; i < msg->payments_count; i++) {
+    const StellarPaymentOpsEntry *payment = &msg->payments[i];
+    stellar_getAddressBytes(payment->destination_account, bytes);
+    const char **str_addr_rows = stellar_lineBreakAddress(bytes);
+
+    // Payment 3 of 12
+    char str_index[32];
+    stellar_format_uint32(i + 1, str_number, sizeof(str_number));
+    strlcpy(str_index, _("Payment "), sizeof(str_index));
+    strlcat(str_index, str_number, sizeof(str_index));
+    stellar_format_uint32(msg->payments_count, str_number, sizeof(str_number));
+    strlcat(str_index, _(" of "), sizeof(str_index));
+    strlcat(str_index, str_number, sizeof(str_index));
+
+    char str_to[32];
+    strlcpy(str_to, _("To: "), sizeof(str_to));
+    strlcat(str_to, str_addr_rows[0], sizeof(str_to));
+
+    stellar_format_stroops(payment->amount, str_amount, sizeof(str_amount));
+    strlcpy(str_pay_amount, _("Pay "), sizeof(str_pay_amount));
+    strlcat(str_pay_amount, str_amount, sizeof(str_pay_amount));
+
+    stellar_layoutTransactionDialog(str_pay_amount, str_index, str_to,
+                                    str_addr_rows[1], str_addr_rows[2]);
+    if (!protectButton(ButtonRequestType_ButtonRequest_ProtectCall, false)) {
+      stellar_signingAbort(_("User canceled"));
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < msg->payments_count; i++) {
+    const StellarPaymentOpsEntry *payment = &msg->payments[i];
+
+    // Hash: source account
+    if (op.has_source_account) {
+      stellar_hashupdate_address(source_account_bytes);
+    } else {
+      stellar_hashupdate_bool(false);
+    }
+    // Hash: operation type
+    stellar_hashupdate_uint32(1);
+    // Hash destination
+    stellar_getAddressBytes(payment->destination_account, bytes);
+    stellar_hashupdate_address(bytes);
+    // asset
+    stellar_hashupdate_asset(&(op.asset));
+    // amount
+    stellar_hashupdate_uint64(payment->amount);
+
+    stellar_activeTx.confirmed_operations++;
+  }
+  return true;
+}
+
 bool stellar_confirmPathPaymentOp(const StellarPathPaymentOp *msg) {
   if (!stellar_signing) return false;
 
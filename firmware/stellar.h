@@ -59,6 +59,7 @@ bool stellar_confirmSourceAccount(bool has_source_account,
                                   const char *str_account);
 bool stellar_confirmCreateAccountOp(const StellarCreateAccountOp *msg);
 bool stellar_confirmPaymentOp(const StellarPaymentOp *msg);
+bool stellar_confirmPaymentOps(const StellarPaymentOps *msg);
 bool stellar_confirmPathPaymentOp(const StellarPathPaymentOp *msg);
 bool stellar_confirmManageOfferOp(const StellarManageOfferOp *msg);
 bool stellar_confirmCreatePassiveOfferOp(
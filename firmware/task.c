@@ -0,0 +1,63 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+
+#include "task.h"
+#include "usb.h"
+
+#define TASK_QUEUE_LEN 4
+
+static TaskFunc queue[TASK_QUEUE_LEN];
+static size_t queued = 0;
+static bool running = false;
+
+bool task_post(TaskFunc func) {
+  for (size_t i = 0; i < queued; i++) {
+    if (queue[i] == func) {
+      return true;
+    }
+  }
+  if (queued == TASK_QUEUE_LEN) {
+    return false;
+  }
+  queue[queued++] = func;
+  return true;
+}
+
+void task_run(void) {
+  if (running) {
+    return;
+  }
+  running = true;
+  while (queued > 0) {
+    TaskFunc func = queue[0];
+    queued--;
+    for (size_t i = 0; i < queued; i++) {
+      queue[i] = queue[i + 1];
+    }
+    func();
+  }
+  running = false;
+}
+
+void task_yield(void) {
+  usbPoll();
+  task_run();
+}
@@ -0,0 +1,46 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2019 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TASK_H__
+#define __TASK_H__
+
+#include <stdbool.h>
+
+/*
+ * While a handler runs, the interfaces only accept the messages it waits
+ * for (see usbTiny). Requests that do not need the user or the state of
+ * that handler, such as GetFeatures, Ping or U2F check-only authenticate,
+ * are posted as tasks instead of being rejected. Tasks run to completion
+ * at the next yield point: the wait loops in protect.c and u2f.c, the
+ * seed derivation progress callback and the main loop.
+ *
+ * Tasks must not wait for the user and must not use the scratch response,
+ * which may belong to the handler that yielded.
+ */
+
+typedef void (*TaskFunc)(void);
+
+// queue func unless it is already queued, false if the queue is full
+bool task_post(TaskFunc func);
+// run queued tasks, does nothing when called from a task
+void task_run(void);
+// poll the interfaces and run the tasks they posted
+void task_yield(void);
+
+#endif
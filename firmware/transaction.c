@@ -29,6 +29,7 @@
 #include "layout2.h"
 #include "memzero.h"
 #include "messages.pb.h"
+#include "profile.h"
 #include "protect.h"
 #include "ripemd160.h"
 #include "segwit_addr.h"
@@ -195,8 +196,8 @@ bool compute_address(const CoinInfo *coin, InputScriptType script_type,
   return 1;
 }
 
-int compile_output(const CoinInfo *coin, const HDNode *root, TxOutputType *in,
-                   TxOutputBinType *out, bool needs_confirm) {
+int compile_output(const CoinInfo *coin, DeriveNodeFunc derive,
+                   TxOutputType *in, TxOutputBinType *out, bool needs_confirm) {
   memzero(out, sizeof(TxOutputBinType));
   out->amount = in->amount;
   out->decred_script_version = in->decred_script_version;
@@ -253,9 +254,7 @@ int compile_output(const CoinInfo *coin, const HDNode *root, TxOutputType *in,
       default:
         return 0;  // failed to compile output
     }
-    memcpy(&node, root, sizeof(HDNode));
-    if (hdnode_private_ckd_cached(&node, in->address_n, in->address_n_count,
-                                  NULL) == 0) {
+    if (derive(in->address_n, in->address_n_count, &node) == 0) {
       return 0;  // failed to compile output
     }
     hdnode_fill_public_key(&node);
@@ -573,6 +572,7 @@ uint32_t tx_serialize_input_hash(TxStruct *tx, const TxInputType *input) {
     // already got all inputs
     return 0;
   }
+  PROFILE_START(PROFILE_TX_HASH);
   uint32_t r = 0;
   if (tx->have_inputs == 0) {
     r += tx_serialize_header_hash(tx);
@@ -587,6 +587,7 @@ uint32_t tx_serialize_input_hash(TxStruct *tx, const TxInputType *input) {
                         input->script_sig.bytes);
   }
   r += tx_sequence_hash(&(tx->hasher), input);
+  PROFILE_END(PROFILE_TX_HASH);
 
   tx->have_inputs++;
   tx->size += r;
@@ -731,6 +732,7 @@ uint32_t tx_serialize_output_hash(TxStruct *tx, const TxOutputBinType *output) {
     // already got all outputs
     return 0;
   }
+  PROFILE_START(PROFILE_TX_HASH);
   uint32_t r = 0;
   if (tx->have_outputs == 0) {
     r += tx_serialize_middle_hash(tx);
@@ -740,6 +742,7 @@ uint32_t tx_serialize_output_hash(TxStruct *tx, const TxOutputBinType *output) {
   if (tx->have_outputs == tx->outputs_len && !tx->is_segwit) {
     r += tx_serialize_footer_hash(tx);
   }
+  PROFILE_END(PROFILE_TX_HASH);
   tx->size += r;
   return r;
 }
@@ -758,7 +761,9 @@ uint32_t tx_serialize_extra_data_hash(TxStruct *tx, const uint8_t *data,
     // we are receiving too much data
     return 0;
   }
+  PROFILE_START(PROFILE_TX_HASH);
   hasher_Update(&(tx->hasher), data, datalen);
+  PROFILE_END(PROFILE_TX_HASH);
   tx->extra_data_received += datalen;
   tx->size += datalen;
   return datalen;
@@ -786,7 +791,9 @@ void tx_init(TxStruct *tx, uint32_t inputs_len, uint32_t outputs_len,
 }
 
 void tx_hash_final(TxStruct *t, uint8_t *hash, bool reverse) {
+  PROFILE_START(PROFILE_TX_HASH);
   hasher_Final(&(t->hasher), hash);
+  PROFILE_END(PROFILE_TX_HASH);
   if (!reverse) return;
   for (uint8_t i = 0; i < 16; i++) {
     uint8_t k = hash[31 - i];
@@ -21,6 +21,7 @@
 #define __TRANSACTION_H__
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "bip32.h"
 #include "coins.h"
@@ -71,8 +72,11 @@ uint32_t serialize_script_sig(const uint8_t *signature, uint32_t signature_len,
 uint32_t serialize_script_multisig(const CoinInfo *coin,
                                    const MultisigRedeemScriptType *multisig,
                                    uint8_t sighash, uint8_t *out);
-int compile_output(const CoinInfo *coin, const HDNode *root, TxOutputType *in,
-                   TxOutputBinType *out, bool needs_confirm);
+// derives the private node of an address path, e.g. from the root node
+typedef int (*DeriveNodeFunc)(const uint32_t *address_n, size_t address_n_count,
+                              HDNode *out);
+int compile_output(const CoinInfo *coin, DeriveNodeFunc derive,
+                   TxOutputType *in, TxOutputBinType *out, bool needs_confirm);
 
 uint32_t tx_prevout_hash(Hasher *hasher, const TxInputType *input);
 uint32_t tx_script_hash(Hasher *hasher, uint32_t size, const uint8_t *data);
@@ -23,13 +23,16 @@
 #include "buttons.h"
 #include "common.h"
 #include "config.h"
+#include "debug_screen.h"
 #include "gettext.h"
 #include "layout.h"
 #include "layout2.h"
 #include "memzero.h"
 #include "oled.h"
+#include "ram.h"
 #include "rng.h"
 #include "setup.h"
+#include "task.h"
 #include "timer.h"
 #include "usb.h"
 #include "util.h"
@@ -116,17 +119,18 @@ static void collect_hw_entropy(bool privileged) {
 #endif
 }
 
-int main(void) {
+void trezor_setup(void) {
 #ifndef APPVER
   setup();
-  __stack_chk_guard = random32();  // this supports compiler provided
-                                   // unpredictable stack protection checks
-  oledInit();
 #else
   check_bootloader();
   setupApp();
-  __stack_chk_guard = random32();  // this supports compiler provided
-                                   // unpredictable stack protection checks
+#endif
+}
+
+void trezor_init(void) {
+#ifndef APPVER
+  oledInit();
 #endif
   if (!is_mode_unprivileged()) {
     collect_hw_entropy(true);
@@ -140,8 +144,16 @@ int main(void) {
   }
 
 #if DEBUG_LINK
+  debug_screen_init();
   oledSetDebugLink(1);
+#if EMULATOR
+  // keep the state of a preloaded flash snapshot
+  if (!emulatorFlashSnapshotLoaded()) {
+    config_wipe();
+  }
+#else
   config_wipe();
+#endif
 #endif
 
   oledDrawBitmap(40, 0, &bmp_logo64);
@@ -150,9 +162,27 @@ int main(void) {
   config_init();
   layoutHome();
   usbInit();
+}
+
+void trezor_poll(void) {
+  task_yield();
+  check_lock_screen();
+}
+
+#if EMULATOR
+// embedding hosts provide their own main and drive trezor_poll themselves
+__attribute__((weak))
+#endif
+int main(void) {
+  ram_paint_stack();
+  trezor_setup();
+  // the guard must not change under a frame which returns later on, so it
+  // is set here rather than in trezor_setup or trezor_init
+  __stack_chk_guard = random32();  // this supports compiler provided
+                                   // unpredictable stack protection checks
+  trezor_init();
   for (;;) {
-    usbPoll();
-    check_lock_screen();
+    trezor_poll();
   }
 
   return 0;
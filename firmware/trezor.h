@@ -37,4 +37,8 @@
 /* Screen timeout */
 extern uint32_t system_millis_lock_start;
 
+void trezor_setup(void);
+void trezor_init(void);
+void trezor_poll(void);
+
 #endif
@@ -31,6 +31,8 @@
 #include "memzero.h"
 #include "nist256p1.h"
 #include "rng.h"
+#include "task.h"
+#include "timer.h"
 #include "trezor.h"
 #include "usb.h"
 #include "util.h"
@@ -41,17 +43,49 @@
 #include "u2f/u2f_keys.h"
 #include "u2f_knownapps.h"
 
-// About 1/2 Second according to values used in protect.c
-#define U2F_TIMEOUT (800000 / 2)
-#define U2F_OUT_PKT_BUFFER_LEN 130
+// About 1/2 Second (in ms)
+#define U2F_TIMEOUT 500
+#define U2F_OUT_QUEUE_LEN 16
 
 // Initialise without a cid
 static uint32_t cid = 0;
 
-// Circular Output buffer
+// Responses in the order they were queued. A response that fits one report
+// is copied into its entry, a longer one is not copied: reports are cut from
+// data when the IN endpoint takes one, so data has to stay valid until
+// u2f_out_pending(data) is false. Reports of the first response go out
+// before anything of the next one.
+typedef struct {
+  const uint8_t *data;
+  uint32_t cid;
+  uint32_t len;
+  uint32_t pos;
+  uint8_t cmd;
+  uint8_t seq;
+  uint8_t buf[HID_RPT_SIZE - 7];
+} U2F_OutMsg;
+
+static U2F_OutMsg u2f_out_queue[U2F_OUT_QUEUE_LEN];
 static uint32_t u2f_out_start = 0;
-static uint32_t u2f_out_end = 0;
-static uint8_t u2f_out_packets[U2F_OUT_PKT_BUFFER_LEN][HID_RPT_SIZE];
+static uint32_t u2f_out_count = 0;
+
+// Whether a queued response still reads from data
+static bool u2f_out_pending(const uint8_t *data) {
+  for (uint32_t i = 0; i < u2f_out_count; i++) {
+    if (u2f_out_queue[(u2f_out_start + i) % U2F_OUT_QUEUE_LEN].data == data) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Lets the host read everything queued, so buffers the responses point
+// into can be reused
+static void u2f_out_wait(void) {
+  while (u2f_out_count > 0) {
+    task_yield();
+  }
+}
 
 #define U2F_PUBKEY_LEN 65
 #define KEY_PATH_LEN 32
@@ -91,12 +125,19 @@ typedef struct {
   uint8_t chal[U2F_CHAL_SIZE];
 } U2F_AUTHENTICATE_SIG_STR;
 
+// Time in ms the current dialog stays open, counted from dialog_start
 static uint32_t dialog_timeout = 0;
+static uint32_t dialog_start = 0;
+
+static void set_dialog_timeout(uint32_t timeout) {
+  dialog_start = timer_ms();
+  dialog_timeout = timeout;
+}
 
 uint32_t next_cid(void) {
   // extremely unlikely but hey
   do {
-    cid = random32();
+    random_buffer((uint8_t *)&cid, sizeof(cid));
   } while (cid == 0 || cid == CID_BROADCAST);
   return cid;
 }
@@ -116,6 +157,88 @@ typedef struct {
 
 U2F_ReadBuffer *reader;
 
+// While the device is busy, a short request on another channel is assembled
+// here and answered by a task if it does not need the user (see task.h).
+// Check-only authenticate is the largest of these.
+typedef struct {
+  uint8_t buf[sizeof(APDU) + sizeof(U2F_AUTHENTICATE_REQ) + 3];
+  uint32_t len;
+  uint32_t pos;
+  uint32_t cid;
+  uint32_t start;
+  uint8_t seq;
+  uint8_t cmd;
+} U2F_BackgroundBuffer;
+
+static U2F_BackgroundBuffer background;
+
+static void u2fhid_background(void) {
+  if (background.cid == 0) {
+    // aborted by init while queued
+    return;
+  }
+  uint32_t saved_cid = cid;
+  cid = background.cid;
+  const APDU *a = (const APDU *)background.buf;
+  if (background.cmd == U2FHID_PING) {
+    u2fhid_ping(background.buf, background.len);
+  } else if (background.len >= sizeof(APDU) && a->cla == 0 &&
+             (a->ins == U2F_VERSION ||
+              (a->ins == U2F_AUTHENTICATE && a->p1 == U2F_AUTH_CHECK_ONLY))) {
+    u2fhid_msg(a, background.len);
+  } else {
+    send_u2fhid_error(cid, ERR_CHANNEL_BUSY);
+  }
+  cid = saved_cid;
+  if (u2f_out_pending(background.buf)) {
+    // a long echo is sent from the buffer, it is wiped by the next request
+    background.cid = 0;
+  } else {
+    memzero(&background, sizeof(background));
+  }
+}
+
+static void u2fhid_read_background(const U2FHID_FRAME *f) {
+  if (f->type & TYPE_INIT) {
+    // one request at a time, an unfinished one is dropped after a timeout
+    bool idle = (background.cid == 0 && !u2f_out_pending(background.buf)) ||
+                (background.pos < background.len &&
+                 timer_ms() - background.start >= U2F_TIMEOUT);
+    if (!idle || (f->type != U2FHID_PING && f->type != U2FHID_MSG) ||
+        f->cid == 0 || f->cid == CID_BROADCAST ||
+        (unsigned)MSG_LEN(*f) > sizeof(background.buf)) {
+      send_u2fhid_error(f->cid, ERR_CHANNEL_BUSY);
+      return;
+    }
+    memzero(&background, sizeof(background));
+    background.cid = f->cid;
+    background.cmd = f->type;
+    background.len = MSG_LEN(*f);
+    background.start = timer_ms();
+    background.pos = MIN(background.len, sizeof(f->init.data));
+    memcpy(background.buf, f->init.data, background.pos);
+  } else {
+    if (f->cid != background.cid || background.pos >= background.len) {
+      send_u2fhid_error(f->cid, ERR_CHANNEL_BUSY);
+      return;
+    }
+    if (f->cont.seq != background.seq) {
+      send_u2fhid_error(f->cid, ERR_INVALID_SEQ);
+      memzero(&background, sizeof(background));
+      return;
+    }
+    uint32_t n = MIN(background.len - background.pos, sizeof(f->cont.data));
+    memcpy(background.buf + background.pos, f->cont.data, n);
+    background.pos += n;
+    background.seq++;
+  }
+
+  if (background.pos >= background.len && !task_post(u2fhid_background)) {
+    send_u2fhid_error(f->cid, ERR_CHANNEL_BUSY);
+    memzero(&background, sizeof(background));
+  }
+}
+
 void u2fhid_read(char tiny, const U2FHID_FRAME *f) {
   // Always handle init packets directly
   if (f->init.cmd == U2FHID_INIT) {
@@ -126,13 +249,16 @@ void u2fhid_read(char tiny, const U2FHID_FRAME *f) {
       reader->len = 0;
       reader->seq = 255;
     }
+    if (f->cid == background.cid) {
+      memzero(&background, sizeof(background));
+    }
     return;
   }
 
   if (tiny) {
     // read continue packet
     if (reader == 0 || cid != f->cid) {
-      send_u2fhid_error(f->cid, ERR_CHANNEL_BUSY);
+      u2fhid_read_background(f);
       return;
     }
 
@@ -201,9 +327,9 @@ void u2fhid_read_start(const U2FHID_FRAME *f) {
     while ((reader->buf_ptr - reader->buf) < (signed)reader->len) {
       uint8_t lastseq = reader->seq;
       uint8_t lastcmd = reader->cmd;
-      int counter = U2F_TIMEOUT;
+      uint32_t start = timer_ms();
       while (reader->seq == lastseq && reader->cmd == lastcmd) {
-        if (counter-- == 0) {
+        if (timer_ms() - start >= U2F_TIMEOUT) {
           // timeout
           send_u2fhid_error(cid, ERR_MSG_TIMEOUT);
           cid = 0;
@@ -212,7 +338,7 @@ void u2fhid_read_start(const U2FHID_FRAME *f) {
           layoutHome();
           return;
         }
-        usbPoll();
+        task_yield();
       }
     }
 
@@ -234,18 +360,24 @@ void u2fhid_read_start(const U2FHID_FRAME *f) {
         send_u2fhid_error(cid, ERR_INVALID_CMD);
         break;
     }
+    // a ping is echoed from the request buffer, register and authenticate
+    // answer from static buffers the next request would overwrite
+    u2f_out_wait();
 
     // wait for next commmand/ button press
     reader->cmd = 0;
     reader->seq = 255;
     while (dialog_timeout > 0 && reader->cmd == 0) {
-      dialog_timeout--;
-      usbPoll();  // may trigger new request
+      if (timer_ms() - dialog_start >= dialog_timeout) {
+        dialog_timeout = 0;
+        break;
+      }
+      task_yield();  // may trigger new request
       buttonUpdate();
       if (button.YesUp && (last_req_state == AUTH || last_req_state == REG)) {
         last_req_state++;
         // standard requires to remember button press for 10 seconds.
-        dialog_timeout = 10 * U2F_TIMEOUT;
+        set_dialog_timeout(10 * U2F_TIMEOUT);
       }
     }
 
@@ -271,19 +403,13 @@ void u2fhid_wink(const uint8_t *buf, uint32_t len) {
 
   if (len > 0) return send_u2fhid_error(cid, ERR_INVALID_LEN);
 
-  if (dialog_timeout > 0) dialog_timeout = U2F_TIMEOUT;
+  if (dialog_timeout > 0) set_dialog_timeout(U2F_TIMEOUT);
 
-  U2FHID_FRAME f;
-  memzero(&f, sizeof(f));
-  f.cid = cid;
-  f.init.cmd = U2FHID_WINK;
-  f.init.bcntl = 0;
-  queue_u2f_pkt(&f);
+  send_u2fhid_msg(U2FHID_WINK, NULL, 0);
 }
 
 void u2fhid_init(const U2FHID_FRAME *in) {
   const U2FHID_INIT_REQ *init_req = (const U2FHID_INIT_REQ *)&in->init.data;
-  U2FHID_FRAME f;
   U2FHID_INIT_RESP resp;
   memzero(&resp, sizeof(resp));
 
@@ -294,12 +420,6 @@ void u2fhid_init(const U2FHID_FRAME *in) {
     return;
   }
 
-  memzero(&f, sizeof(f));
-  f.cid = in->cid;
-  f.init.cmd = U2FHID_INIT;
-  f.init.bcnth = 0;
-  f.init.bcntl = sizeof(resp);
-
   memcpy(resp.nonce, init_req->nonce, sizeof(init_req->nonce));
   resp.cid = in->cid == CID_BROADCAST ? next_cid() : in->cid;
   resp.versionInterface = U2FHID_IF_VERSION;
@@ -307,28 +427,71 @@ void u2fhid_init(const U2FHID_FRAME *in) {
   resp.versionMinor = VERSION_MINOR;
   resp.versionBuild = VERSION_PATCH;
   resp.capFlags = CAPFLAG_WINK;
-  memcpy(&f.init.data, &resp, sizeof(resp));
 
-  queue_u2f_pkt(&f);
+  queue_u2fhid_msg(in->cid, U2FHID_INIT, (const uint8_t *)&resp,
+                   sizeof(resp));
 }
 
-void queue_u2f_pkt(const U2FHID_FRAME *u2f_pkt) {
-  // debugLog(0, "", "u2f_write_pkt");
-  uint32_t next = (u2f_out_end + 1) % U2F_OUT_PKT_BUFFER_LEN;
-  if (u2f_out_start == next) {
-    debugLog(0, "", "u2f_write_pkt full");
-    return;  // Buffer full :(
+void queue_u2fhid_msg(uint32_t fcid, uint8_t cmd, const uint8_t *data,
+                      uint32_t len) {
+  if (len > U2F_MAXIMUM_PAYLOAD_LENGTH) {
+    debugLog(0, "", "queue_u2fhid_msg too long");
+    return;
+  }
+
+  // the host takes a report per flush, each one brings the first response
+  // closer to leaving the queue
+  while (u2f_out_count == U2F_OUT_QUEUE_LEN) {
+    usbFlushU2F();
   }
-  memcpy(u2f_out_packets[u2f_out_end], u2f_pkt, HID_RPT_SIZE);
-  u2f_out_end = next;
+
+  // debugLog(0, "", "queue_u2fhid_msg");
+  U2F_OutMsg *m =
+      &u2f_out_queue[(u2f_out_start + u2f_out_count) % U2F_OUT_QUEUE_LEN];
+  memzero(m, sizeof(*m));
+  m->cid = fcid;
+  m->cmd = cmd;
+  m->len = len;
+  if (len <= sizeof(m->buf)) {
+    if (len > 0) memcpy(m->buf, data, len);
+    m->data = m->buf;
+  } else {
+    m->data = data;
+  }
+  u2f_out_count++;
 }
 
 uint8_t *u2f_out_data(void) {
-  if (u2f_out_start == u2f_out_end) return NULL;  // No data
+  static U2FHID_FRAME f;
+
+  if (u2f_out_count == 0) return NULL;  // No data
   // debugLog(0, "", "u2f_out_data");
-  uint32_t t = u2f_out_start;
-  u2f_out_start = (u2f_out_start + 1) % U2F_OUT_PKT_BUFFER_LEN;
-  return u2f_out_packets[t];
+  U2F_OutMsg *m = &u2f_out_queue[u2f_out_start];
+
+  memzero(&f, sizeof(f));
+  f.cid = m->cid;
+  uint32_t psz;
+  if (m->pos == 0) {
+    // Init packet
+    f.init.cmd = m->cmd;
+    f.init.bcnth = m->len >> 8;
+    f.init.bcntl = m->len & 0xff;
+    psz = MIN(sizeof(f.init.data), m->len);
+    memcpy(f.init.data, m->data, psz);
+  } else {
+    // Cont packet
+    f.cont.seq = m->seq++;
+    psz = MIN(sizeof(f.cont.data), m->len - m->pos);
+    memcpy(f.cont.data, m->data + m->pos, psz);
+  }
+
+  m->pos += psz;
+  if (m->pos >= m->len) {
+    memzero(m, sizeof(*m));
+    u2f_out_start = (u2f_out_start + 1) % U2F_OUT_QUEUE_LEN;
+    u2f_out_count--;
+  }
+  return (uint8_t *)&f;
 }
 
 void u2fhid_msg(const APDU *a, uint32_t len) {
@@ -362,57 +525,12 @@ void u2fhid_msg(const APDU *a, uint32_t len) {
 
 void send_u2fhid_msg(const uint8_t cmd, const uint8_t *data,
                      const uint32_t len) {
-  if (len > U2F_MAXIMUM_PAYLOAD_LENGTH) {
-    debugLog(0, "", "send_u2fhid_msg failed");
-    return;
-  }
-
-  U2FHID_FRAME f;
-  uint8_t *p = (uint8_t *)data;
-  uint32_t l = len;
-  uint32_t psz;
-  uint8_t seq = 0;
-
   // debugLog(0, "", "send_u2fhid_msg");
-
-  memzero(&f, sizeof(f));
-  f.cid = cid;
-  f.init.cmd = cmd;
-  f.init.bcnth = len >> 8;
-  f.init.bcntl = len & 0xff;
-
-  // Init packet
-  psz = MIN(sizeof(f.init.data), l);
-  memcpy(f.init.data, p, psz);
-  queue_u2f_pkt(&f);
-  l -= psz;
-  p += psz;
-
-  // Cont packet(s)
-  for (; l > 0; l -= psz, p += psz) {
-    // debugLog(0, "", "send_u2fhid_msg con");
-    memzero(&f.cont.data, sizeof(f.cont.data));
-    f.cont.seq = seq++;
-    psz = MIN(sizeof(f.cont.data), l);
-    memcpy(f.cont.data, p, psz);
-    queue_u2f_pkt(&f);
-  }
-
-  if (data + len != p) {
-    debugLog(0, "", "send_u2fhid_msg is bad");
-    debugInt(data + len - p);
-  }
+  queue_u2fhid_msg(cid, cmd, data, len);
 }
 
 void send_u2fhid_error(uint32_t fcid, uint8_t err) {
-  U2FHID_FRAME f;
-
-  memzero(&f, sizeof(f));
-  f.cid = fcid;
-  f.init.cmd = U2FHID_ERROR;
-  f.init.bcntl = 1;
-  f.init.data[0] = err;
-  queue_u2f_pkt(&f);
+  queue_u2fhid_msg(fcid, U2FHID_ERROR, &err, 1);
 }
 
 void u2f_version(const APDU *a) {
@@ -474,9 +592,10 @@ static const HDNode *generateKeyHandle(const uint8_t app_id[],
 
   // Derivation path is m/U2F'/r'/r'/r'/r'/r'/r'/r'/r'
   uint32_t key_path[KEY_PATH_ENTRIES];
+  random_buffer((uint8_t *)key_path, sizeof(key_path));
   for (uint32_t i = 0; i < KEY_PATH_ENTRIES; i++) {
     // high bit for hardened keys
-    key_path[i] = 0x80000000 | random32();
+    key_path[i] |= 0x80000000;
   }
 
   // First half of keyhandle is key_path
@@ -569,13 +688,14 @@ void u2f_register(const APDU *a) {
   if (last_req_state == REG) {
     // error: testof-user-presence is required
     send_u2f_error(U2F_SW_CONDITIONS_NOT_SATISFIED);
-    dialog_timeout = U2F_TIMEOUT;
+    set_dialog_timeout(U2F_TIMEOUT);
     return;
   }
 
   // Buttons said yes
   if (last_req_state == REG_PASS) {
-    uint8_t data[sizeof(U2F_REGISTER_RESP) + 2];
+    // sent without a copy, so it has to outlive this call
+    static uint8_t data[sizeof(U2F_REGISTER_RESP) + 2];
     U2F_REGISTER_RESP *resp = (U2F_REGISTER_RESP *)&data;
     memzero(data, sizeof(data));
 
@@ -626,13 +746,13 @@ void u2f_register(const APDU *a) {
             resp->keyHandleLen + sizeof(U2F_ATT_CERT) + sig_len + 2;
 
     last_req_state = INIT;
-    dialog_timeout = 0;
+    set_dialog_timeout(0);
     send_u2f_msg(data, l);
     return;
   }
 
   // Didnt expect to get here
-  dialog_timeout = 0;
+  set_dialog_timeout(0);
 }
 
 void u2f_authenticate(const APDU *a) {
@@ -700,13 +820,14 @@ void u2f_authenticate(const APDU *a) {
   if (last_req_state == AUTH) {
     // error: testof-user-presence is required
     send_u2f_error(U2F_SW_CONDITIONS_NOT_SATISFIED);
-    dialog_timeout = U2F_TIMEOUT;
+    set_dialog_timeout(U2F_TIMEOUT);
     return;
   }
 
   // Buttons said yes
   if (last_req_state == AUTH_PASS) {
-    uint8_t buf[sizeof(U2F_AUTHENTICATE_RESP) + 2];
+    // sent without a copy, so it has to outlive this call
+    static uint8_t buf[sizeof(U2F_AUTHENTICATE_RESP) + 2];
     U2F_AUTHENTICATE_RESP *resp = (U2F_AUTHENTICATE_RESP *)&buf;
 
     const uint32_t ctr = config_nextU2FCounter();
@@ -737,7 +858,7 @@ void u2f_authenticate(const APDU *a) {
     memcpy(buf + sizeof(U2F_AUTHENTICATE_RESP) - U2F_MAX_EC_SIG_SIZE + sig_len,
            "\x90\x00", 2);
     last_req_state = INIT;
-    dialog_timeout = 0;
+    set_dialog_timeout(0);
     send_u2f_msg(
         buf, sizeof(U2F_AUTHENTICATE_RESP) - U2F_MAX_EC_SIG_SIZE + sig_len + 2);
   }
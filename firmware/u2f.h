@@ -45,7 +45,8 @@ void u2fhid_wink(const uint8_t *buf, uint32_t len);
 void u2fhid_sync(const uint8_t *buf, uint32_t len);
 void u2fhid_lock(const uint8_t *buf, uint32_t len);
 void u2fhid_msg(const APDU *a, uint32_t len);
-void queue_u2f_pkt(const U2FHID_FRAME *u2f_pkt);
+void queue_u2fhid_msg(uint32_t fcid, uint8_t cmd, const uint8_t *data,
+                      uint32_t len);
 
 uint8_t *u2f_out_data(void);
 void u2f_register(const APDU *a);
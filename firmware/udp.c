@@ -22,8 +22,10 @@
 #include "usb.h"
 
 #include "debug.h"
+#include "debug_screen.h"
 #include "messages.h"
 #include "timer.h"
+#include "u2f.h"
 
 static volatile char tiny = 0;
 
@@ -35,33 +37,71 @@ void usbInit(void) { emulatorSocketInit(); }
 #define _ISDBG ('n')
 #endif
 
-void usbPoll(void) {
-  emulatorPoll();
-
+static bool usbRead(void) {
   static uint8_t buffer[64];
 
   int iface = 0;
-  if (emulatorSocketRead(&iface, buffer, sizeof(buffer)) > 0) {
-    if (!tiny) {
-      msg_read_common(_ISDBG, buffer, sizeof(buffer));
-    } else {
-      msg_read_tiny(buffer, sizeof(buffer));
-    }
+  if (emulatorSocketRead(&iface, buffer, sizeof(buffer)) == 0) {
+    return false;
+  }
+  if (!tiny) {
+    msg_read_common(_ISDBG, buffer, sizeof(buffer));
+  } else {
+    msg_read_tiny(buffer, sizeof(buffer));
   }
+  return true;
+}
 
-  const uint8_t *data = msg_out_data();
-  if (data != NULL) {
+// reports stay queued until the socket can take them
+static bool usbWrite(void) {
+  bool written = false;
+  const uint8_t *data = NULL;
+  if (emulatorSocketWritable(0) && (data = msg_out_data()) != NULL) {
     emulatorSocketWrite(0, data, 64);
+    written = true;
   }
 
 #if DEBUG_LINK
-  data = msg_debug_out_data();
-  if (data != NULL) {
+  debug_screen_poll();
+  if (emulatorSocketWritable(1) && (data = msg_debug_out_data()) != NULL) {
     emulatorSocketWrite(1, data, 64);
+    written = true;
   }
 #endif
+  return written;
+}
+
+void usbPoll(void) {
+  emulatorPoll();
+  usbRead();
+  usbWrite();
 }
 
+bool usbWait(uint32_t millis) {
+  uint32_t start = timer_ms();
+  for (;;) {
+    emulatorPoll();
+    if (usbRead()) {
+      return true;
+    }
+    // send everything queued before going to sleep
+    if (usbWrite()) {
+      continue;
+    }
+    uint32_t elapsed = timer_ms() - start;
+    if (elapsed >= millis) {
+      return false;
+    }
+    if (!emulatorSocketWait(millis - elapsed)) {
+      // with virtual time the clock only moves forward here
+      emulatorAdvanceTime(millis - elapsed);
+    }
+  }
+}
+
+// the emulator has no U2F interface, pending reports are dropped
+void usbFlushU2F(void) { u2f_out_data(); }
+
 char usbTiny(char set) {
   char old = tiny;
   tiny = set;
@@ -73,5 +113,10 @@ void usbSleep(uint32_t millis) {
 
   while ((timer_ms() - start) < millis) {
     usbPoll();
+    // with virtual time the clock only moves forward here
+    uint32_t elapsed = timer_ms() - start;
+    if (elapsed < millis) {
+      emulatorAdvanceTime(millis - elapsed);
+    }
   }
 }
@@ -22,6 +22,7 @@
 
 #include "config.h"
 #include "debug.h"
+#include "debug_screen.h"
 #include "messages.h"
 #include "timer.h"
 #include "trezor.h"
@@ -278,6 +279,8 @@ static enum usbd_request_return_codes hid_control_request(
 }
 
 static volatile char tiny = 0;
+// set by the rx callbacks, see usbWait
+static volatile bool received = false;
 
 static void main_rx_callback(usbd_device *dev, uint8_t ep) {
   (void)ep;
@@ -285,6 +288,7 @@ static void main_rx_callback(usbd_device *dev, uint8_t ep) {
   if (usbd_ep_read_packet(dev, ENDPOINT_ADDRESS_MAIN_OUT, buf, 64) != 64)
     return;
   debugLog(0, "", "main_rx_callback");
+  received = true;
   if (!tiny) {
     msg_read(buf, 64);
   } else {
@@ -298,6 +302,7 @@ static void u2f_rx_callback(usbd_device *dev, uint8_t ep) {
 
   debugLog(0, "", "u2f_rx_callback");
   if (usbd_ep_read_packet(dev, ENDPOINT_ADDRESS_U2F_OUT, buf, 64) != 64) return;
+  received = true;
   u2fhid_read(tiny, (const U2FHID_FRAME *)(void *)buf);
 }
 
@@ -308,6 +313,7 @@ static void debug_rx_callback(usbd_device *dev, uint8_t ep) {
   if (usbd_ep_read_packet(dev, ENDPOINT_ADDRESS_DEBUG_OUT, buf, 64) != 64)
     return;
   debugLog(0, "", "debug_rx_callback");
+  received = true;
   if (!tiny) {
     msg_debug_read(buf, 64);
   } else {
@@ -381,13 +387,9 @@ void usbPoll(void) {
            64) {
     }
   }
-  data = u2f_out_data();
-  if (data) {
-    while (usbd_ep_write_packet(usbd_dev, ENDPOINT_ADDRESS_U2F_IN, data, 64) !=
-           64) {
-    }
-  }
+  usbFlushU2F();
 #if DEBUG_LINK
+  debug_screen_poll();
   // write pending debug data
   data = msg_debug_out_data();
   if (data) {
@@ -398,6 +400,27 @@ void usbPoll(void) {
 #endif
 }
 
+void usbFlushU2F(void) {
+  const uint8_t *data = u2f_out_data();
+  if (data) {
+    while (usbd_ep_write_packet(usbd_dev, ENDPOINT_ADDRESS_U2F_IN, data, 64) !=
+           64) {
+    }
+  }
+}
+
+bool usbWait(uint32_t millis) {
+  uint32_t start = timer_ms();
+  received = false;
+  do {
+    usbPoll();
+    if (received) {
+      return true;
+    }
+  } while ((timer_ms() - start) < millis);
+  return false;
+}
+
 void usbReconnect(void) {
   if (usbd_dev != NULL) {
     usbd_disconnect(usbd_dev, 1);
@@ -20,10 +20,17 @@
 #ifndef __USB_H__
 #define __USB_H__
 
+#include <stdbool.h>
+#include <stdint.h>
+
 void usbInit(void);
 void usbPoll(void);
 void usbReconnect(void);
 char usbTiny(char set);
 void usbSleep(uint32_t millis);
+// poll until one report has been read or millis pass, true if one was read
+bool usbWait(uint32_t millis);
+// send the next pending U2F report, waiting until the host takes it
+void usbFlushU2F(void);
 
 #endif
@@ -23,6 +23,7 @@
 #include "common.h"
 #include "flash.h"
 #include "memory.h"
+#include "profile.h"
 #include "supervise.h"
 
 static const uint32_t FLASH_SECTOR_TABLE[FLASH_SECTOR_COUNT + 1] = {
@@ -70,9 +71,11 @@ const void *flash_get_address(uint8_t sector, uint32_t offset, uint32_t size) {
 }
 
 secbool flash_erase(uint8_t sector) {
+  PROFILE_START(PROFILE_STORAGE);
   ensure(flash_unlock_write(), NULL);
   svc_flash_erase_sector(sector);
   ensure(flash_lock_write(), NULL);
+  PROFILE_END(PROFILE_STORAGE);
 
   // Check whether the sector was really deleted (contains only 0xFF).
   const uint32_t addr_start = FLASH_SECTOR_TABLE[sector],
@@ -95,8 +98,13 @@ secbool flash_write_byte(uint8_t sector, uint32_t offset, uint8_t data) {
     return secfalse;
   }
 
+  PROFILE_START(PROFILE_STORAGE);
   svc_flash_program(FLASH_CR_PROGRAM_X8);
   *(volatile uint8_t *)address = data;
+#if EMULATOR
+  emulatorFlashDirty(address, sizeof(data));
+#endif
+  PROFILE_END(PROFILE_STORAGE);
 
   if (*address != data) {
     return secfalse;
@@ -119,8 +127,13 @@ secbool flash_write_word(uint8_t sector, uint32_t offset, uint32_t data) {
     return secfalse;
   }
 
+  PROFILE_START(PROFILE_STORAGE);
   svc_flash_program(FLASH_CR_PROGRAM_X32);
   *(volatile uint32_t *)address = data;
+#if EMULATOR
+  emulatorFlashDirty(address, sizeof(data));
+#endif
+  PROFILE_END(PROFILE_STORAGE);
 
   if (*address != data) {
     return secfalse;
@@ -96,9 +96,15 @@ int memory_bootloader_hash(uint8_t *hash);
 
 static inline void flash_write32(uint32_t addr, uint32_t word) {
   *(volatile uint32_t *)FLASH_PTR(addr) = word;
+#if EMULATOR
+  emulatorFlashDirty(FLASH_PTR(addr), sizeof(word));
+#endif
 }
 static inline void flash_write8(uint32_t addr, uint8_t byte) {
   *(volatile uint8_t *)FLASH_PTR(addr) = byte;
+#if EMULATOR
+  emulatorFlashDirty(FLASH_PTR(addr), sizeof(byte));
+#endif
 }
 
 #endif
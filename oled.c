@@ -24,6 +24,7 @@
 
 #include "memzero.h"
 #include "oled.h"
+#include "profile.h"
 #include "util.h"
 
 #define OLED_SETCONTRAST 0x81
@@ -66,6 +67,7 @@
 
 static uint8_t _oledbuffer[OLED_BUFSIZE];
 static bool is_debug_link = 0;
+static void (*refresh_hook)(const uint8_t *buf) = 0;
 
 /*
  * macros to convert coordinate to bit position
@@ -204,6 +206,7 @@ void oledRefresh() {
   static const uint8_t s[3] = {OLED_SETLOWCOLUMN | 0x00,
                                OLED_SETHIGHCOLUMN | 0x00,
                                OLED_SETSTARTLINE | 0x00};
+  PROFILE_START(PROFILE_OLED_REFRESH);
 
   // draw triangle in upper right corner
   oledInvertDebugLink();
@@ -220,9 +223,25 @@ void oledRefresh() {
 
   // return it back
   oledInvertDebugLink();
+  oledRefreshed();
+  PROFILE_END(PROFILE_OLED_REFRESH);
 }
 #endif
 
+/*
+ * Register a function to be called with the buffer after every refresh,
+ * so that a debug link can follow what is shown on the display.
+ */
+void oledSetRefreshHook(void (*hook)(const uint8_t *buf)) {
+  refresh_hook = hook;
+}
+
+void oledRefreshed(void) {
+  if (refresh_hook) {
+    refresh_hook(_oledbuffer);
+  }
+}
+
 const uint8_t *oledGetBuffer() { return _oledbuffer; }
 
 void oledSetDebugLink(bool set) {
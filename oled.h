@@ -33,6 +33,8 @@
 void oledInit(void);
 void oledClear(void);
 void oledRefresh(void);
+void oledSetRefreshHook(void (*hook)(const uint8_t *buf));
+void oledRefreshed(void);
 
 void oledSetDebugLink(bool set);
 void oledInvertDebugLink(void);
@@ -0,0 +1,79 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (c) SatoshiLabs
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#if EMULATOR
+#include <time.h>
+#else
+#include <libopencm3/cm3/dwt.h>
+#endif
+
+#include "profile.h"
+
+static const char *const zone_names[PROFILE_ZONE_COUNT] = {
+    [PROFILE_MSG_PROCESS] = "msg_process",
+    [PROFILE_PB_DECODE] = "pb_decode",
+    [PROFILE_PB_ENCODE] = "pb_encode",
+    [PROFILE_HDNODE_CKD] = "hdnode_ckd",
+    [PROFILE_ECDSA_SIGN] = "ecdsa_sign",
+    [PROFILE_TX_HASH] = "tx_hash",
+    [PROFILE_OLED_REFRESH] = "oled_refresh",
+    [PROFILE_STORAGE] = "storage",
+};
+
+static ProfileCounter counters[PROFILE_ZONE_COUNT];
+
+uint64_t profile_now(void) {
+#if EMULATOR
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#else
+  static bool enabled = false;
+  if (!enabled) {
+    enabled = dwt_enable_cycle_counter();
+  }
+  return dwt_read_cycle_counter();
+#endif
+}
+
+void profile_add(ProfileZone zone, uint64_t start) {
+#if EMULATOR
+  uint64_t elapsed = profile_now() - start;
+#else
+  // the cycle counter is 32 bits wide and wraps around
+  uint64_t elapsed = (uint32_t)(profile_now() - start);
+#endif
+  ProfileCounter *c = &counters[zone];
+  c->calls++;
+  c->total += elapsed;
+  if (elapsed > c->max) {
+    c->max = elapsed;
+  }
+}
+
+const char *profile_name(ProfileZone zone) { return zone_names[zone]; }
+
+const ProfileCounter *profile_counter(ProfileZone zone) {
+  return &counters[zone];
+}
+
+void profile_reset(void) { memset(counters, 0, sizeof(counters)); }
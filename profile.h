@@ -0,0 +1,61 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (c) SatoshiLabs
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <stdint.h>
+
+// Profiling zones measure cycles on the device and nanoseconds in the
+// emulator. They are only compiled in with PROFILE_ZONES, which is enabled
+// for debug link builds and forced off without the debug link.
+
+typedef enum {
+  PROFILE_MSG_PROCESS,   // decoding and handling a whole message
+  PROFILE_PB_DECODE,     // protobuf decoding of incoming messages
+  PROFILE_PB_ENCODE,     // protobuf encoding of outgoing messages
+  PROFILE_HDNODE_CKD,    // BIP-32 private key derivation
+  PROFILE_ECDSA_SIGN,    // transaction input signatures
+  PROFILE_TX_HASH,       // hashing in tx_serialize_*_hash and tx_hash_final
+  PROFILE_OLED_REFRESH,  // copying the frame buffer to the display
+  PROFILE_STORAGE,       // erasing and programming the storage flash
+  PROFILE_ZONE_COUNT
+} ProfileZone;
+
+typedef struct {
+  uint32_t calls;
+  uint64_t total;
+  uint64_t max;
+} ProfileCounter;
+
+uint64_t profile_now(void);
+void profile_add(ProfileZone zone, uint64_t start);
+const char *profile_name(ProfileZone zone);
+const ProfileCounter *profile_counter(ProfileZone zone);
+void profile_reset(void);
+
+#if PROFILE_ZONES
+#define PROFILE_START(zone) const uint64_t profile_start_##zone = profile_now()
+#define PROFILE_END(zone) profile_add(zone, profile_start_##zone)
+#else
+#define PROFILE_START(zone)
+#define PROFILE_END(zone)
+#endif
+
+#endif
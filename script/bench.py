@@ -0,0 +1,380 @@
+#!/usr/bin/env python3
+
+# script/bench.py: Measure throughput and latency of a fixed message corpus
+#                  against a running emulator built with DEBUG_LINK=1.
+
+import argparse
+import hashlib
+import json
+import struct
+import sys
+import time
+
+from trezorlib import btc, debuglink, device, ethereum, messages, misc, nem, stellar
+from trezorlib.debuglink import TrezorClientDebugLink
+from trezorlib.exceptions import TrezorFailure
+from trezorlib.tools import parse_path
+from trezorlib.transport import get_transport
+
+MNEMONIC = " ".join(["all"] * 12)
+
+DEFAULT_PATH = "udp:127.0.0.1:21324"
+DEFAULT_OUTPUT = "bench.json"
+DEFAULT_ITERATIONS = 20
+
+OUTPUT_ADDRESS = "bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4"
+PREV_AMOUNT = 100000
+FEE_PER_INPUT = 1000
+
+
+def sha256d(data):
+    return hashlib.sha256(hashlib.sha256(data).digest()).digest()
+
+
+def varint(n):
+    if n < 0xFD:
+        return struct.pack("<B", n)
+    if n <= 0xFFFF:
+        return b"\xfd" + struct.pack("<H", n)
+    return b"\xfe" + struct.pack("<I", n)
+
+
+def prev_tx(i):
+    # a one-input one-output transaction paying PREV_AMOUNT, unique per i
+    tx = messages.TransactionType(
+        version=1,
+        lock_time=0,
+        inputs=[
+            messages.TxInputType(
+                prev_hash=hashlib.sha256(struct.pack("<I", i)).digest(),
+                prev_index=0,
+                script_sig=b"",
+                sequence=0xFFFFFFFF,
+            )
+        ],
+        bin_outputs=[
+            messages.TxOutputBinType(
+                amount=PREV_AMOUNT,
+                script_pubkey=bytes.fromhex("76a914") + bytes(20) + b"\x88\xac",
+            )
+        ],
+    )
+    raw = struct.pack("<I", tx.version) + varint(len(tx.inputs))
+    for inp in tx.inputs:
+        raw += inp.prev_hash[::-1] + struct.pack("<I", inp.prev_index)
+        raw += varint(len(inp.script_sig)) + inp.script_sig
+        raw += struct.pack("<I", inp.sequence)
+    raw += varint(len(tx.bin_outputs))
+    for out in tx.bin_outputs:
+        raw += struct.pack("<Q", out.amount)
+        raw += varint(len(out.script_pubkey)) + out.script_pubkey
+    raw += struct.pack("<I", tx.lock_time)
+    return sha256d(raw)[::-1], tx
+
+
+def multisig(client):
+    nodes = [
+        btc.get_public_node(client, parse_path("48'/0'/%d'/2'" % i)).node
+        for i in range(3)
+    ]
+    return messages.MultisigRedeemScriptType(
+        pubkeys=[messages.HDNodePathType(node=n, address_n=[0, 0]) for n in nodes],
+        signatures=[b""] * 3,
+        m=2,
+    )
+
+
+def sign_tx_case(client, kind, count):
+    prev_txes = {}
+    inputs = []
+    # the cosigners are the same for every input
+    redeem = multisig(client) if kind == "multisig" else None
+    for i in range(count):
+        prev_hash, tx = prev_tx(i)
+        if kind == "p2pkh":
+            prev_txes[prev_hash] = tx
+            inp = messages.TxInputType(
+                address_n=parse_path("44'/0'/0'/0/0"),
+                script_type=messages.InputScriptType.SPENDADDRESS,
+            )
+        elif kind == "p2wpkh":
+            inp = messages.TxInputType(
+                address_n=parse_path("84'/0'/0'/0/0"),
+                script_type=messages.InputScriptType.SPENDWITNESS,
+            )
+        else:
+            inp = messages.TxInputType(
+                address_n=parse_path("48'/0'/0'/2'/0/0"),
+                script_type=messages.InputScriptType.SPENDWITNESS,
+                multisig=redeem,
+            )
+        inp.prev_hash = prev_hash
+        inp.prev_index = 0
+        inp.amount = PREV_AMOUNT
+        inputs.append(inp)
+    outputs = [
+        messages.TxOutputType(
+            address=OUTPUT_ADDRESS,
+            amount=count * (PREV_AMOUNT - FEE_PER_INPUT),
+            script_type=messages.OutputScriptType.PAYTOADDRESS,
+        )
+    ]
+    return lambda: btc.sign_tx(
+        client, "Bitcoin", inputs, outputs, prev_txes=prev_txes
+    )
+
+
+def stellar_case(client, count):
+    source = stellar.get_address(client, parse_path("44'/148'/0'"))
+    tx = messages.StellarSignTx(
+        source_account=source,
+        fee=100 * count,
+        sequence_number=1,
+        timebounds_start=0,
+        timebounds_end=0,
+        memo_type=0,
+    )
+    operations = [
+        messages.StellarPaymentOp(
+            destination_account=source,
+            asset=messages.StellarAssetType(type=0),
+            amount=10000000 + i,
+        )
+        for i in range(count)
+    ]
+    return lambda: stellar.sign_tx(
+        client, tx, operations, parse_path("44'/148'/0'")
+    )
+
+
+def nem_case(client, count):
+    transaction = {
+        "timeStamp": 74649215,
+        "amount": 1000000,
+        "fee": 1000000,
+        "recipient": "TALICE2GMA34CXHD7XLJQ536NM5UNKQHTORNNT2J",
+        "type": nem.TYPE_TRANSACTION_TRANSFER,
+        "deadline": 74735615,
+        "message": {},
+        "mosaics": [
+            {
+                "mosaicId": {"namespaceId": "bench", "name": "mosaic%d" % i},
+                "quantity": 1000 + i,
+            }
+            for i in range(count)
+        ],
+        "version": (0x98 << 24) | 2,
+    }
+    return lambda: nem.sign_tx(client, parse_path("44'/1'/0'/0'/0'"), transaction)
+
+
+def corpus():
+    # (name, weight, coin, setup), setup(client) returns the call to measure
+    # and only runs for cases that are selected and supported
+    cases = []
+    for name, path, script_type in (
+        ("p2pkh", "44'/0'/0'/0/0", messages.InputScriptType.SPENDADDRESS),
+        ("p2sh-p2wpkh", "49'/0'/0'/0/0", messages.InputScriptType.SPENDP2SHWITNESS),
+        ("p2wpkh", "84'/0'/0'/0/0", messages.InputScriptType.SPENDWITNESS),
+    ):
+        cases.append(
+            (
+                "GetAddress/" + name,
+                1,
+                "Bitcoin",
+                lambda client, p=path, s=script_type: lambda: btc.get_address(
+                    client, "Bitcoin", parse_path(p), script_type=s
+                ),
+            )
+        )
+    cases.append(
+        (
+            "GetPublicKey",
+            1,
+            "Bitcoin",
+            lambda client: lambda: btc.get_public_node(
+                client, parse_path("44'/0'/0'")
+            ),
+        )
+    )
+    cases.append(
+        (
+            "SignMessage",
+            1,
+            "Bitcoin",
+            lambda client: lambda: btc.sign_message(
+                client, "Bitcoin", parse_path("44'/0'/0'/0/0"), "bench" * 200
+            ),
+        )
+    )
+    for kind in ("p2pkh", "p2wpkh", "multisig"):
+        for count in (1, 10, 100):
+            name = "SignTx/%s/%d" % (kind, count)
+            cases.append(
+                (
+                    name,
+                    count,
+                    "Bitcoin",
+                    lambda client, k=kind, c=count: sign_tx_case(client, k, c),
+                )
+            )
+    cases.append(
+        (
+            "EthereumSignTx/data-8k",
+            10,
+            "Ethereum",
+            lambda client: lambda: ethereum.sign_tx(
+                client,
+                n=parse_path("44'/60'/0'/0/0"),
+                nonce=0,
+                gas_price=20000000000,
+                gas_limit=200000,
+                to="0x1d1c328764a41bda0492b66baa30c4a339ff85ef",
+                value=0,
+                data=bytes(range(256)) * 32,
+                chain_id=1,
+            ),
+        )
+    )
+    cases.append(
+        (
+            "StellarSignTx/10-ops",
+            10,
+            "Stellar",
+            lambda client: stellar_case(client, 10),
+        )
+    )
+    cases.append(
+        ("NEMSignTx/10-mosaics", 10, "NEM", lambda client: nem_case(client, 10))
+    )
+    cases.append(
+        (
+            "CipherKeyValue",
+            1,
+            "Bitcoin",
+            lambda client: lambda: misc.encrypt_keyvalue(
+                client,
+                parse_path("10016'/0"),
+                "bench",
+                bytes(1024),
+                ask_on_encrypt=False,
+                ask_on_decrypt=False,
+            ),
+        )
+    )
+    return cases
+
+
+# a cheap request per coin, firmware built without the coin (BITCOIN_ONLY=1)
+# answers it with Failure_UnexpectedMessage
+PROBES = {
+    "Ethereum": lambda client: ethereum.get_address(
+        client, parse_path("44'/60'/0'/0/0")
+    ),
+    "Stellar": lambda client: stellar.get_address(client, parse_path("44'/148'/0'")),
+    "NEM": lambda client: nem.get_address(
+        client, parse_path("44'/1'/0'/0'/0'"), 0x98
+    ),
+}
+
+
+def coin_supported(client, coin, cache):
+    if coin not in PROBES:
+        return True
+    if coin not in cache:
+        try:
+            PROBES[coin](client)
+            cache[coin] = True
+        except TrezorFailure as e:
+            if e.code != messages.FailureType.UnexpectedMessage:
+                raise
+            cache[coin] = False
+    return cache[coin]
+
+
+# the emulator has no U2F HID interface, report these as skipped
+SKIPPED = {
+    "U2F/register": "no U2F transport in the emulator",
+    "U2F/authenticate": "no U2F transport in the emulator",
+}
+
+
+def percentile(values, p):
+    values = sorted(values)
+    index = max(0, min(len(values) - 1, int(round(p / 100 * len(values))) - 1))
+    return values[index]
+
+
+def run(fn, iterations):
+    latencies = []
+    start = time.perf_counter()
+    for _ in range(iterations):
+        t = time.perf_counter()
+        fn()
+        latencies.append(time.perf_counter() - t)
+    total = time.perf_counter() - start
+    return {
+        "iterations": iterations,
+        "ops_per_sec": iterations / total,
+        "p50_ms": percentile(latencies, 50) * 1000,
+        "p99_ms": percentile(latencies, 99) * 1000,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark the emulator.")
+    parser.add_argument("-p", "--path", default=DEFAULT_PATH)
+    parser.add_argument("-o", "--output", default=DEFAULT_OUTPUT)
+    parser.add_argument("-n", "--iterations", type=int, default=DEFAULT_ITERATIONS)
+    parser.add_argument("-k", "--filter", default="", help="run matching cases only")
+    args = parser.parse_args()
+
+    client = TrezorClientDebugLink(get_transport(args.path))
+    device.wipe(client)
+    debuglink.load_device_by_mnemonic(
+        client,
+        mnemonic=MNEMONIC,
+        pin="",
+        passphrase_protection=False,
+        label="bench",
+    )
+    client.init_device()
+    f = client.features
+
+    results = []
+    supported = {}
+    for name, weight, coin, setup in corpus():
+        if args.filter not in name:
+            continue
+        if not coin_supported(client, coin, supported):
+            results.append({"name": name, "skipped": coin + " not in firmware"})
+            print("{:28} skipped, no {}".format(name, coin), file=sys.stderr)
+            continue
+        # heavy cases run fewer times, but always at least twice
+        iterations = max(2, args.iterations // weight)
+        result = run(setup(client), iterations)
+        result["name"] = name
+        results.append(result)
+        print(
+            "{:28} {:8.2f} ops/s  p50 {:9.1f} ms  p99 {:9.1f} ms".format(
+                name, result["ops_per_sec"], result["p50_ms"], result["p99_ms"]
+            ),
+            file=sys.stderr,
+        )
+    for name, reason in SKIPPED.items():
+        if args.filter in name:
+            results.append({"name": name, "skipped": reason})
+
+    report = {
+        "firmware_version": "%d.%d.%d"
+        % (f.major_version, f.minor_version, f.patch_version),
+        "revision": f.revision.hex() if f.revision else None,
+        "timestamp": int(time.time()),
+        "cases": results,
+    }
+    with open(args.output, "w") as out:
+        json.dump(report, out, indent=2, sort_keys=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+
+# script/stack_usage.py: Report the worst case stack depth and scratch arena
+#                        use of every message handler from -fstack-usage
+#                        output, the scratch allocation sites (both from a
+#                        build with STACK_USAGE=1) and the call graph of the
+#                        linked ELF.
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+DEFAULT_ROOT = "fsm_msg"
+# firmware/task.h: task_run calls the posted tasks through a pointer, they
+# run on top of any handler that yields
+DEFAULT_TASKS = ["msg_process_background", "u2fhid_background"]
+# firmware/scratch.h: SCRATCH_RESPONSE_SIZE is taken by every handler
+DEFAULT_SCRATCH_BASE = 3 * 1024
+
+FUNCTION_RE = re.compile(r"^[0-9a-f]+ <([^>]+)>:$")
+# direct calls and tail calls on Cortex-M and x86, branches inside the same
+# function (<name+0x..>) are not calls
+CALL_RE = re.compile(
+    r"\s(?:bl|blx|b\.w|b|call|callq|jmp|jmpq)\s+[0-9a-f]+ <([^>+]+)>$"
+)
+INDIRECT_RE = re.compile(r"\s(?:blx\s+r\d+|bx\s+r\d+|call[q]?\s+\*|jmp[q]?\s+\*)")
+# labels left by SCRATCH_SITE, see firmware/scratch.h
+SITE_PREFIX = "__scratch_site_"
+NM_RE = re.compile(r"^([0-9a-f]+) (?:([0-9a-f]+) )?([a-zA-Z]) (\S+)$")
+
+
+def read_frames(roots):
+    # static functions may share a name, so keep the biggest frame
+    frames = {}
+    unbounded = set()
+    for root in roots:
+        for dirpath, _, filenames in os.walk(root):
+            for filename in filenames:
+                if not filename.endswith(".su"):
+                    continue
+                with open(os.path.join(dirpath, filename)) as f:
+                    for line in f:
+                        location, size, kind = line.rstrip("\n").split("\t")
+                        name = location.rsplit(":", 1)[-1]
+                        frames[name] = max(frames.get(name, 0), int(size))
+                        if kind not in ("static", "dynamic,bounded"):
+                            unbounded.add(name)
+    return frames, unbounded
+
+
+def read_calls(objdump, elf):
+    output = subprocess.check_output([objdump, "-d", "--no-show-raw-insn", elf])
+    calls = {}
+    indirect = set()
+    current = None
+    for line in output.decode().splitlines():
+        m = FUNCTION_RE.match(line)
+        if m and m.group(1).startswith(SITE_PREFIX):
+            # a label inside the current function
+            continue
+        if m:
+            current = m.group(1)
+            calls.setdefault(current, set())
+            continue
+        if current is None:
+            continue
+        m = CALL_RE.search(line)
+        if m and m.group(1).startswith(SITE_PREFIX):
+            continue
+        if m and m.group(1) != current:
+            calls[current].add(m.group(1))
+        elif INDIRECT_RE.search(line):
+            indirect.add(current)
+    return calls, indirect
+
+
+def read_scratch(nm, elf):
+    # objdump names an address after one symbol only, so a site at the very
+    # start of a function would be lost, place the sites with nm instead
+    output = subprocess.check_output([nm, "-S", "--defined-only", elf])
+    functions = []
+    sites = []
+    for line in output.decode().splitlines():
+        m = NM_RE.match(line)
+        if not m:
+            continue
+        address = int(m.group(1), 16) & ~1  # thumb bit
+        name = m.group(4)
+        if name.startswith(SITE_PREFIX):
+            sites.append((address, int(name.rsplit("_", 1)[1])))
+        elif m.group(2) and m.group(3) in "tTwW":
+            functions.append((address, address + int(m.group(2), 16), name))
+
+    scratch = {}
+    for address, size in sites:
+        for start, end, name in functions:
+            if start <= address < end:
+                scratch[name] = scratch.get(name, 0) + size
+                break
+    return scratch
+
+
+class Analysis:
+    def __init__(self, frames, unbounded, calls, indirect, scratch):
+        self.frames = frames
+        self.unbounded = unbounded
+        self.calls = calls
+        self.indirect = indirect
+        self.scratch = scratch
+        self.memo = {}
+        self.scratch_memo = {}
+
+    def worst(self, name, stack=()):
+        """Return (depth, path, flags) of the deepest call chain from name."""
+        if name in self.memo:
+            return self.memo[name]
+        flags = set()
+        if name not in self.frames:
+            flags.add("unknown")
+        if name in self.unbounded:
+            flags.add("dynamic")
+        if name in self.indirect:
+            flags.add("indirect")
+
+        best = (0, (), set())
+        for callee in sorted(self.calls.get(name, ())):
+            if callee in stack or callee == name:
+                flags.add("recursive")
+                continue
+            result = self.worst(callee, stack + (name,))
+            if result[0] > best[0]:
+                best = result
+            flags |= result[2]
+
+        result = (
+            self.frames.get(name, 0) + best[0],
+            (name,) + best[1],
+            flags,
+        )
+        self.memo[name] = result
+        return result
+
+    def worst_scratch(self, name, stack=()):
+        """Return the scratch arena bytes allocated along the worst chain.
+
+        Allocations released before the next one are still added up, so
+        this is an upper bound.
+        """
+        if name in self.scratch_memo:
+            return self.scratch_memo[name]
+        best = 0
+        for callee in self.calls.get(name, ()):
+            if callee in stack or callee == name:
+                continue
+            best = max(best, self.worst_scratch(callee, stack + (name,)))
+        result = self.scratch.get(name, 0) + best
+        self.scratch_memo[name] = result
+        return result
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Worst case stack depth per message handler."
+    )
+    parser.add_argument("elf")
+    parser.add_argument("roots", nargs="+", help="directories with .su files")
+    parser.add_argument("--objdump", default="objdump")
+    parser.add_argument("--nm", default="nm")
+    parser.add_argument(
+        "--scratch-base",
+        type=int,
+        default=DEFAULT_SCRATCH_BASE,
+        help="scratch bytes reserved for the response",
+    )
+    parser.add_argument("--prefix", default=DEFAULT_ROOT)
+    parser.add_argument(
+        "--task",
+        action="append",
+        help="function posted with task_post (default: {})".format(
+            ", ".join(DEFAULT_TASKS)
+        ),
+    )
+    args = parser.parse_args()
+
+    frames, unbounded = read_frames(args.roots)
+    if not frames:
+        sys.exit("No .su files found, build with STACK_USAGE=1")
+    calls, indirect = read_calls(args.objdump, args.elf)
+    scratch = read_scratch(args.nm, args.elf)
+    if "task_run" in calls:
+        tasks = args.task or DEFAULT_TASKS
+        calls["task_run"].update(name for name in tasks if name in calls)
+        indirect.discard("task_run")
+
+    analysis = Analysis(frames, unbounded, calls, indirect, scratch)
+    handlers = sorted(name for name in calls if name.startswith(args.prefix))
+    results = sorted(
+        (analysis.worst(name) for name in handlers), key=lambda r: -r[0]
+    )
+
+    peak = 0
+    for depth, path, flags in results:
+        used = args.scratch_base + analysis.worst_scratch(path[0])
+        peak = max(peak, used)
+        line = "{:6}  {:6}  {:40}  {}".format(
+            depth, used, path[0], " ".join(sorted(flags))
+        )
+        print(line.rstrip())
+        print("                " + " > ".join(path[1:]))
+    print("\nscratch arena peak: {} bytes".format(peak))
+    print(
+        "\ncolumns: stack bytes, scratch arena bytes, handler\n"
+        "dynamic: variable frame size (VLA or alloca), indirect: calls "
+        "through pointers are not followed, except from task_run to the "
+        "tasks, recursive: cycles are cut",
+        file=sys.stderr,
+    )
+
+
+if __name__ == "__main__":
+    main()